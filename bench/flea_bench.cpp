@@ -0,0 +1,258 @@
+#include "flea_bench.hpp"
+#include "flea_synth.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+// the phases that regressions in the grammar, the AST and the symbol
+// table show up in
+static const char *const front_end[] = {"lexing", "parsing", "declarations",
+                                        "semantic analysis"};
+
+// below these, a growth is taken for noise
+static constexpr double noise_ms = 5, noise_kib = 1024;
+
+double BenchResult::get(const std::string &name) const {
+  for (const auto &[key, value] : metrics)
+    if (key == name)
+      return value;
+  return -1;
+}
+
+static void set(BenchResult &result, const std::string &name, double value) {
+  for (auto &[key, old] : result.metrics)
+    if (key == name)
+      return old = value, void();
+  result.metrics.emplace_back(name, value);
+}
+
+static std::string quote(const std::string &s) {
+  std::string q = "'";
+  for (char c : s)
+    q += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  return q + "'";
+}
+
+// The text between the quotes that open at pos, moving pos past them.
+static std::string quoted(const std::string &line, size_t &pos) {
+  size_t begin = line.find('"', pos) + 1, end = line.find('"', begin);
+  pos = end + 1;
+  return line.substr(begin, end - begin);
+}
+
+// Reads the report of one run, as TimeReport::print writes it, into the
+// times of the phases and the sizes.
+static void read_report(std::istream &in, BenchResult &run) {
+  std::string line, section;
+  double nodes = 0, front = 0, total = 0;
+  while (std::getline(in, line)) {
+    size_t pos = 0;
+    if (line.find(": [") != std::string::npos ||
+        line.find(": {") != std::string::npos) {
+      section = quoted(line, pos);
+    } else if (section == "phases" &&
+               line.find("\"name\"") != std::string::npos) {
+      quoted(line, pos);
+      std::string name = quoted(line, pos);
+      quoted(line, pos);
+      double ms = std::strtod(line.c_str() + line.find(':', pos) + 1, nullptr);
+      set(run, "ms:" + name, ms);
+      total += ms;
+      if (std::find(std::begin(front_end), std::end(front_end), name) !=
+          std::end(front_end))
+        front += ms;
+    } else if ((section == "ast_nodes" || section == "sizes") &&
+               line.find('"') != std::string::npos) {
+      std::string name = quoted(line, pos);
+      double value =
+          std::strtod(line.c_str() + line.find(':', pos) + 1, nullptr);
+      if (section == "ast_nodes")
+        nodes += value;
+      else if (name == "tokens")
+        set(run, "tokens", value);
+      else if (name == "peak_rss_kib")
+        set(run, "peak KiB", value);
+    }
+  }
+  if (total == 0 || nodes == 0)
+    throw bench_error("Invalid time report");
+  set(run, "nodes", nodes);
+  set(run, "ms:front end", front);
+  set(run, "ms:total", total);
+}
+
+BenchResult measure(const std::string &fleac,
+                    const std::vector<std::string> &options,
+                    const std::string &preset, int32_t size, int32_t repeat) {
+  SynthShape shape;
+  if (!synth_preset(preset, size, shape))
+    throw bench_error("Unknown preset: " + preset);
+  auto stem = std::filesystem::temp_directory_path() /
+              ("flea_bench_" + std::to_string(getpid()));
+  std::string source = stem.string() + ".sy", json = stem.string() + ".json";
+  {
+    std::ofstream out(source);
+    synthesize(shape, out);
+    if (!out)
+      throw bench_error("Failed to write file: " + source);
+  }
+  std::string command = quote(fleac);
+  for (const auto &option : options)
+    command += " " + quote(option);
+  command += " --time-report=json -o /dev/null " + quote(source) + " 2> " +
+             quote(json);
+
+  // the sizes are the same in every run, the times and peak the least
+  BenchResult result{preset, size, {}};
+  set(result, "bytes", static_cast<double>(std::filesystem::file_size(source)));
+  for (int32_t i = 0; i < repeat; ++i) {
+    if (std::system(command.c_str()))
+      throw bench_error("fleac failed on " + preset + " " +
+                        std::to_string(size) + ", its program is in " +
+                        source);
+    BenchResult run;
+    std::ifstream in(json);
+    read_report(in, run);
+    for (const auto &[name, value] : run.metrics) {
+      double best = result.get(name);
+      bool least = name.starts_with("ms:") || name == "peak KiB";
+      set(result, name, best >= 0 && least ? std::min(best, value) : value);
+    }
+  }
+  set(result, "nodes/s",
+      result.get("nodes") * 1000 / std::max(result.get("ms:front end"), 1e-3));
+  std::filesystem::remove(source);
+  std::filesystem::remove(json);
+  return result;
+}
+
+void write_results(std::ostream &out,
+                   const std::vector<BenchResult> &results) {
+  out << std::setprecision(12);
+  for (const auto &result : results)
+    for (const auto &[name, value] : result.metrics)
+      out << result.preset << " " << result.size << " " << value << " "
+          << name << "\n";
+}
+
+std::vector<BenchResult> read_results(std::istream &in) {
+  std::vector<BenchResult> results;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.starts_with("#"))
+      continue;
+    std::istringstream fields(line);
+    std::string preset, name;
+    int32_t size;
+    double value;
+    if (!(fields >> preset >> size >> value) ||
+        !std::getline(fields >> std::ws, name))
+      throw bench_error("Invalid results: " + line);
+    if (results.empty() || results.back().preset != preset ||
+        results.back().size != size)
+      results.push_back({preset, size, {}});
+    set(results.back(), name, value);
+  }
+  return results;
+}
+
+static const BenchResult *same_run(const std::vector<BenchResult> *results,
+                                   const BenchResult &result) {
+  if (results)
+    for (const auto &other : *results)
+      if (other.preset == result.preset && other.size == result.size)
+        return &other;
+  return nullptr;
+}
+
+// the change from base to now in percent, as a column
+static std::string change(double now, double base) {
+  if (now < 0 || base <= 0)
+    return "-";
+  char text[32];
+  snprintf(text, sizeof text, "%+.1f%%", (now / base - 1) * 100);
+  return text;
+}
+
+int32_t report(std::ostream &out, const std::vector<BenchResult> &results,
+               const std::vector<BenchResult> *baseline, double threshold) {
+  char line[256];
+  snprintf(line, sizeof line, "%-8s %5s %11s %10s %10s %10s %10s %9s",
+           "preset", "size", "bytes", "nodes", "front ms", "total ms",
+           "Mnodes/s", "peak MiB");
+  out << line;
+  if (baseline)
+    snprintf(line, sizeof line, " %8s %8s %8s", "front", "total", "peak"),
+        out << line;
+  out << "\n";
+  for (const auto &r : results) {
+    snprintf(line, sizeof line,
+             "%-8s %5d %11.0f %10.0f %10.2f %10.2f %10.2f %9.1f",
+             r.preset.c_str(), r.size, r.get("bytes"), r.get("nodes"),
+             r.get("ms:front end"), r.get("ms:total"), r.get("nodes/s") / 1e6,
+             r.get("peak KiB") / 1024);
+    out << line;
+    if (const BenchResult *base = same_run(baseline, r)) {
+      snprintf(line, sizeof line, " %8s %8s %8s",
+               change(r.get("ms:front end"), base->get("ms:front end")).c_str(),
+               change(r.get("ms:total"), base->get("ms:total")).c_str(),
+               change(r.get("peak KiB"), base->get("peak KiB")).c_str());
+      out << line;
+    }
+    out << "\n";
+  }
+
+  // time per node at the largest size of a preset over that at the least,
+  // 1 if it grows linearly
+  for (size_t i = 0; i < results.size();) {
+    size_t j = i;
+    while (j + 1 < results.size() && results[j + 1].preset == results[i].preset)
+      ++j;
+    if (j > i) {
+      const BenchResult &a = results[i], &b = results[j];
+      auto growth = [&](const char *name) {
+        return (b.get(name) / b.get("nodes")) / (a.get(name) / a.get("nodes"));
+      };
+      snprintf(line, sizeof line,
+               "%s: time per node x%.2f in the front end and x%.2f in total "
+               "from size %d to %d\n",
+               a.preset.c_str(), growth("ms:front end"), growth("ms:total"),
+               a.size, b.size);
+      out << line;
+    }
+    i = j + 1;
+  }
+  if (!baseline)
+    return 0;
+
+  int32_t regressions = 0;
+  for (const auto &r : results) {
+    const BenchResult *base = same_run(baseline, r);
+    if (!base)
+      continue;
+    if (base->get("nodes") != r.get("nodes"))
+      out << r.preset << " " << r.size << ": " << r.get("nodes")
+          << " nodes, the baseline had " << base->get("nodes")
+          << "; the grammar or the generator changed\n";
+    for (const auto &[name, now] : r.metrics) {
+      bool is_ms = name.starts_with("ms:");
+      double before = base->get(name);
+      if ((!is_ms && name != "peak KiB") || before < 0 ||
+          now <= before * (1 + threshold / 100) ||
+          now - before <= (is_ms ? noise_ms : noise_kib))
+        continue;
+      if (!regressions++)
+        out << "Regressions beyond " << threshold << "%:\n";
+      snprintf(line, sizeof line, "  %s %d %s: %.2f -> %.2f (%s)\n",
+               r.preset.c_str(), r.size, name.c_str(), before, now,
+               change(now, before).c_str());
+      out << line;
+    }
+  }
+  return regressions;
+}
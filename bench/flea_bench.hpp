@@ -0,0 +1,46 @@
+#ifndef FLEA_BENCH_HPP_FLAG
+#define FLEA_BENCH_HPP_FLAG
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct bench_error : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// What fleac's --time-report=json tells of compiling one synthetic
+// program, the best of several runs: "ms:<phase>" for each phase,
+// "ms:front end" for lexing, parsing, declarations and semantic analysis
+// together, "ms:total", "nodes" for the AST nodes made, "nodes/s" through
+// the front end, "peak KiB", and the program's "bytes" and "tokens".
+struct BenchResult {
+  std::string preset;
+  int32_t size = 0;
+  std::vector<std::pair<std::string, double>> metrics;
+  // the metric of that name, negative if there is none
+  double get(const std::string &name) const;
+};
+
+// Compiles the program of the preset at that size repeat times with
+// fleac and its options; throws bench_error if it fails.
+BenchResult measure(const std::string &fleac,
+                    const std::vector<std::string> &options,
+                    const std::string &preset, int32_t size, int32_t repeat);
+
+// Results as text, one metric per line: preset, size, value and name.
+// Lines starting with '#' are comments.
+void write_results(std::ostream &out, const std::vector<BenchResult> &results);
+std::vector<BenchResult> read_results(std::istream &in);
+
+// Prints a table of the results and how time per node grows with size.
+// With a baseline, also prints the change in time and memory of each
+// result it has, and lists the phases and peaks that grew by more than
+// threshold percent and by more than noise; returns how many did.
+int32_t report(std::ostream &out, const std::vector<BenchResult> &results,
+               const std::vector<BenchResult> *baseline, double threshold);
+
+#endif // FLEA_BENCH_HPP_FLAG
@@ -0,0 +1,331 @@
+#include "flea_synth.hpp"
+#include <algorithm>
+
+const std::vector<std::string> &synth_presets() {
+  static const std::vector<std::string> names = {"funcs", "nest",   "chain",
+                                                 "table", "idents", "mixed"};
+  return names;
+}
+
+bool synth_preset(const std::string &name, int32_t size, SynthShape &shape) {
+  uint64_t seed = shape.seed;
+  if (name == "funcs")
+    shape = {250 * size, 6, 2, 4, 0, 0, seed};
+  else if (name == "nest")
+    shape = {4, 2, 100 * size, 3, 0, 0, seed};
+  else if (name == "chain")
+    shape = {4, 4, 1, 100 * size, 0, 0, seed};
+  else if (name == "table")
+    shape = {8, 4, 1, 4, 4096 * size, 0, seed};
+  else if (name == "idents")
+    shape = {50, 4, 1, 4, 0, 2000 * size, seed};
+  else if (name == "mixed")
+    shape = {60 * size, 4, 8, 12, 256 * size, 200 * size, seed};
+  else
+    return false;
+  return true;
+}
+
+namespace {
+// Syllables of three letters: a prefix letter and the digits of a number
+// in base 20 make names that are distinct for distinct numbers and that
+// are never keywords or library functions.
+constexpr const char *syllables[] = {
+    "bar", "cel", "dor", "fen", "gul", "hax", "jip", "kor", "lum", "mav",
+    "nep", "pox", "quo", "rid", "sut", "vim", "wex", "yar", "zon", "tib"};
+constexpr int32_t nsyllables = 20;
+constexpr int32_t table_cols = 16, table_rows = 64, max_indent = 32;
+
+class Synth {
+public:
+  Synth(const SynthShape &shape, std::ostream &out)
+      : shape(shape), out(out), state(shape.seed) {}
+  void program();
+
+private:
+  struct Table {
+    std::string name;
+    int32_t rows;
+  };
+  const SynthShape &shape;
+  std::ostream &out;
+  uint64_t state;
+  std::vector<Table> tables;
+  std::vector<std::string> consts, globals, funcs;
+  std::vector<int32_t> arity;
+  // the parameters and locals in scope, shadowed ones included
+  std::vector<std::string> scope;
+  int32_t func = 0, parens = 0;
+  bool called = false;
+
+  uint32_t pick(uint32_t n);
+  static std::string name(char prefix, int32_t k);
+  void indent(int32_t level);
+  void operand();
+  void expr(int32_t terms);
+  void cond();
+  void assign(int32_t level);
+  void stmt(int32_t level);
+  void items(int32_t level);
+  void nested(int32_t level);
+  void function(int32_t i);
+};
+} // namespace
+
+// splitmix64, so that a seed gives the same program everywhere
+uint32_t Synth::pick(uint32_t n) {
+  uint64_t z = (state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return static_cast<uint32_t>((z ^ (z >> 31)) % n);
+}
+
+std::string Synth::name(char prefix, int32_t k) {
+  std::string s(1, prefix);
+  do
+    s += syllables[k % nsyllables], k /= nsyllables;
+  while (k);
+  return s;
+}
+
+void Synth::indent(int32_t level) {
+  out << std::string(2 * std::min(level, max_indent), ' ');
+}
+
+void Synth::operand() {
+  switch (pick(10)) {
+  case 0:
+  case 1:
+    out << pick(100);
+    break;
+  case 2:
+    if (!consts.empty() || !globals.empty()) {
+      uint32_t k = pick(static_cast<uint32_t>(consts.size() + globals.size()));
+      out << (k < consts.size() ? consts[k] : globals[k - consts.size()]);
+      break;
+    }
+    [[fallthrough]];
+  case 3:
+    if (!tables.empty()) {
+      const Table &t = tables[pick(static_cast<uint32_t>(tables.size()))];
+      out << t.name << "[";
+      if (pick(2))
+        out << pick(static_cast<uint32_t>(t.rows));
+      else
+        out << "(" << scope[pick(static_cast<uint32_t>(scope.size()))] << " % "
+            << t.rows << " + " << t.rows << ") % " << t.rows;
+      out << "][" << pick(table_cols) << "]";
+      break;
+    }
+    [[fallthrough]];
+  case 4:
+    if (parens < 2) {
+      ++parens;
+      out << "(";
+      expr(2 + static_cast<int32_t>(pick(3)));
+      out << ")";
+      --parens;
+      break;
+    }
+    [[fallthrough]];
+  default:
+    if (!pick(16))
+      out << "-";
+    out << scope[pick(static_cast<uint32_t>(scope.size()))];
+  }
+}
+
+// Divides only by constants that are not zero.
+void Synth::expr(int32_t terms) {
+  static const char ops[] = "+-*+-*+-/%";
+  operand();
+  for (int32_t i = 1; i < terms; ++i) {
+    char op = ops[pick(sizeof(ops) - 1)];
+    out << " " << op << " ";
+    if (op == '/' || op == '%')
+      out << 1 + pick(9);
+    else
+      operand();
+  }
+}
+
+void Synth::cond() {
+  static const char *rels[] = {"<", ">", "<=", ">=", "==", "!="};
+  if (!pick(8))
+    out << "!";
+  expr(std::max(shape.chain / 2, 1));
+  out << " " << rels[pick(6)] << " ";
+  expr(std::max(shape.chain / 2, 1));
+}
+
+void Synth::assign(int32_t level) {
+  indent(level);
+  if (!globals.empty() && !pick(4))
+    out << globals[pick(static_cast<uint32_t>(globals.size()))];
+  else
+    out << scope[pick(static_cast<uint32_t>(scope.size()))];
+  out << " = ";
+  expr(shape.chain);
+  out << ";\n";
+}
+
+// Makes at most one call per function, so that calls cost no more than
+// linear time at run time and in evaluation at compile time.
+void Synth::stmt(int32_t level) {
+  switch (pick(6)) {
+  case 0:
+    if (func > 0 && !called) {
+      called = true;
+      auto callee = static_cast<int32_t>(pick(static_cast<uint32_t>(func)));
+      indent(level);
+      out << scope[pick(static_cast<uint32_t>(scope.size()))] << " = "
+          << funcs[callee] << "(";
+      for (int32_t k = 0; k < arity[callee]; ++k) {
+        out << (k ? ", " : "");
+        expr(std::max(shape.chain / 4, 1));
+      }
+      out << ");\n";
+      return;
+    }
+    [[fallthrough]];
+  case 1:
+    indent(level);
+    out << "if (";
+    cond();
+    out << ")\n";
+    assign(level + 1);
+    indent(level);
+    out << "else\n";
+    assign(level + 1);
+    return;
+  default:
+    assign(level);
+  }
+}
+
+// The items of a block: the locals, several distinct ones at the top of a
+// function and below one that often shadows another, the statements and
+// the next level. A local's initializer does not read its own name.
+void Synth::items(int32_t level) {
+  auto vocabulary = static_cast<int32_t>(64 + shape.idents + shape.stmts);
+  int32_t locals = level == 1 ? std::max(shape.stmts / 2, 1) : 1;
+  auto first = static_cast<int32_t>(pick(static_cast<uint32_t>(vocabulary)));
+  for (int32_t i = 0; i < locals; ++i) {
+    std::string local = level > 1 && pick(2)
+                            ? scope[pick(static_cast<uint32_t>(scope.size()))]
+                            : name('l', (first + i) % vocabulary);
+    std::vector<std::string> outer = scope;
+    std::erase(scope, local);
+    indent(level);
+    out << "int " << local << " = ";
+    expr(shape.chain);
+    out << ";\n";
+    scope = std::move(outer);
+    scope.push_back(local);
+  }
+  for (int32_t i = 0; i < shape.stmts; ++i)
+    stmt(level);
+  if (level <= shape.depth)
+    nested(level);
+}
+
+void Synth::nested(int32_t level) {
+  auto mark = scope.size();
+  indent(level);
+  switch (pick(3)) {
+  case 0:
+    out << "if (";
+    cond();
+    out << ") {\n";
+    items(level + 1);
+    scope.resize(mark);
+    indent(level);
+    out << "} else\n";
+    assign(level + 1);
+    break;
+  case 1:
+    out << "while (";
+    cond();
+    out << ") {\n";
+    items(level + 1);
+    indent(level + 1);
+    out << "break;\n";
+    indent(level);
+    out << "}\n";
+    break;
+  default:
+    out << "{\n";
+    items(level + 1);
+    indent(level);
+    out << "}\n";
+  }
+  scope.resize(mark);
+}
+
+void Synth::function(int32_t i) {
+  func = i, called = false;
+  scope.clear();
+  out << "int " << funcs[i] << "(";
+  for (int32_t k = 0; k < arity[i]; ++k) {
+    scope.push_back(name('a', k));
+    out << (k ? ", " : "") << "int " << scope.back();
+  }
+  out << ") {\n";
+  items(1);
+  indent(1);
+  out << "return ";
+  expr(shape.chain);
+  out << ";\n}\n";
+}
+
+void Synth::program() {
+  // a quarter of the identifiers are constants, some of them used in the
+  // tables, the rest variables; they are declared eight to a line
+  for (int32_t k = 0; k < shape.idents; ++k)
+    (k % 4 ? globals : consts).push_back(name(k % 4 ? 'g' : 'c', k));
+  auto declare = [&](const char *type, const std::vector<std::string> &names) {
+    for (size_t k = 0; k < names.size(); ++k)
+      out << (k % 8 ? ", " : type) << names[k] << " = " << pick(1000)
+          << (k % 8 == 7 || k + 1 == names.size() ? ";\n" : "");
+  };
+  declare("const int ", consts);
+  declare("int ", globals);
+  for (int32_t left = shape.table; left > 0;) {
+    int32_t rows = std::min(table_rows, (left + table_cols - 1) / table_cols);
+    left -= rows * table_cols;
+    tables.push_back({name('t', static_cast<int32_t>(tables.size())), rows});
+    out << "const int " << tables.back().name << "[" << rows << "]["
+        << table_cols << "] = {\n";
+    for (int32_t r = 0; r < rows; ++r) {
+      out << "  {";
+      for (int32_t c = 0; c < table_cols; ++c) {
+        out << (c ? ", " : "");
+        if (!consts.empty() && !pick(8))
+          out << consts[pick(static_cast<uint32_t>(consts.size()))] << " + ";
+        out << static_cast<int32_t>(pick(2000)) - 1000;
+      }
+      out << (r + 1 < rows ? "},\n" : "}\n");
+    }
+    out << "};\n";
+  }
+  for (int32_t i = 0; i < shape.funcs; ++i) {
+    funcs.push_back(name('f', i));
+    arity.push_back(1 + static_cast<int32_t>(pick(3)));
+  }
+  for (int32_t i = 0; i < shape.funcs; ++i)
+    function(i);
+  // main calls each function once, so most functions have a single call
+  // site and the inliner's budget for a caller is what bounds main
+  out << "int main() {\n  int s = getint();\n";
+  for (int32_t i = 0; i < shape.funcs; ++i) {
+    out << "  s = s + " << funcs[i] << "(s";
+    for (int32_t k = 1; k < arity[i]; ++k)
+      out << ", " << pick(100);
+    out << ");\n";
+  }
+  out << "  putint(s);\n  return 0;\n}\n";
+}
+
+void synthesize(const SynthShape &shape, std::ostream &out) {
+  Synth(shape, out).program();
+}
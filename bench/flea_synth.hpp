@@ -0,0 +1,29 @@
+#ifndef FLEA_SYNTH_HPP_FLAG
+#define FLEA_SYNTH_HPP_FLAG
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// The shape of a synthetic SysY program. Each level of a function body
+// holds stmts statements and, down to depth levels, one nested block that
+// shadows a local; expressions have chain operands. The const tables and
+// globals are named from a vocabulary that grows with their number.
+struct SynthShape {
+  int32_t funcs = 1, stmts = 4, depth = 1, chain = 4;
+  int32_t table = 0, idents = 0;
+  uint64_t seed = 1;
+};
+
+// The presets, each growing a shape linearly with size; the shape is left
+// as is for an unknown name.
+const std::vector<std::string> &synth_presets();
+bool synth_preset(const std::string &name, int32_t size, SynthShape &shape);
+
+// Writes a program of the shape, the same for the same shape. It reads
+// one integer, prints one and terminates: calls go to functions defined
+// before and every loop breaks out in its first iteration.
+void synthesize(const SynthShape &shape, std::ostream &out);
+
+#endif // FLEA_SYNTH_HPP_FLAG
@@ -0,0 +1,146 @@
+#include "flea_bench.hpp"
+#include "flea_synth.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static int32_t number(const char *arg) {
+  return static_cast<int32_t>(strtol(arg, nullptr, 10));
+}
+
+template <typename T> static vector<T> split(const char *arg) {
+  vector<T> items;
+  istringstream in(arg);
+  for (string item; getline(in, item, ',');)
+    if constexpr (is_same_v<T, string>)
+      items.push_back(item);
+    else
+      items.push_back(number(item.c_str()));
+  return items;
+}
+
+// Writes a synthetic program: the preset at the size, then any counts
+// given on their own.
+static int generate(int argc, const char *argv[]) {
+  const char *preset = nullptr;
+  int32_t size = 1;
+  SynthShape shape;
+  for (int i = 2; i < argc; ++i)
+    if (!strncmp(argv[i], "--preset=", 9))
+      preset = argv[i] + 9;
+    else if (!strncmp(argv[i], "--size=", 7))
+      size = number(argv[i] + 7);
+    else if (!strncmp(argv[i], "--seed=", 7))
+      shape.seed = strtoull(argv[i] + 7, nullptr, 10);
+  if (preset && !synth_preset(preset, size, shape))
+    throw bench_error("Unknown preset: " + string(preset));
+  for (int i = 2; i < argc; ++i) {
+    static const pair<const char *, int32_t SynthShape::*> counts[] = {
+        {"--funcs=", &SynthShape::funcs},   {"--stmts=", &SynthShape::stmts},
+        {"--depth=", &SynthShape::depth},   {"--chain=", &SynthShape::chain},
+        {"--table=", &SynthShape::table},   {"--idents=", &SynthShape::idents}};
+    bool known = !strncmp(argv[i], "--preset=", 9) ||
+                 !strncmp(argv[i], "--size=", 7) ||
+                 !strncmp(argv[i], "--seed=", 7);
+    for (auto [prefix, count] : counts)
+      if (!strncmp(argv[i], prefix, strlen(prefix)))
+        shape.*count = max(number(argv[i] + strlen(prefix)), 0), known = true;
+    if (!known)
+      throw bench_error("Invalid argument: " + string(argv[i]));
+  }
+  shape.funcs = max(shape.funcs, 0), shape.chain = max(shape.chain, 1);
+  synthesize(shape, cout);
+  return 0;
+}
+
+// Measures fleac on the presets at the sizes; returns 2 if there are
+// regressions against the baseline.
+static int run(int argc, const char *argv[]) {
+  string fleac = argv[2];
+  vector<string> presets = synth_presets(), options;
+  vector<int32_t> sizes = {1, 2, 4, 8};
+  int32_t repeat = 3;
+  double threshold = 10;
+  const char *baseline_file = nullptr, *output = nullptr;
+  for (int i = 3; i < argc; ++i)
+    if (!strncmp(argv[i], "--presets=", 10))
+      presets = split<string>(argv[i] + 10);
+    else if (!strncmp(argv[i], "--sizes=", 8))
+      sizes = split<int32_t>(argv[i] + 8);
+    else if (!strncmp(argv[i], "--repeat=", 9))
+      repeat = max(number(argv[i] + 9), 1);
+    else if (!strncmp(argv[i], "--threshold=", 12))
+      threshold = strtod(argv[i] + 12, nullptr);
+    else if (!strncmp(argv[i], "--baseline=", 11))
+      baseline_file = argv[i] + 11;
+    else if (!strncmp(argv[i], "--output=", 9))
+      output = argv[i] + 9;
+    else if (!strcmp(argv[i], "--"))
+      options.assign(argv + i + 1, argv + argc), i = argc;
+    else
+      throw bench_error("Invalid argument: " + string(argv[i]));
+
+  // the options are kept in the results, as times taken with others do
+  // not compare
+  string header = "# fleac";
+  for (const auto &option : options)
+    header += " " + option;
+  vector<BenchResult> baseline;
+  if (baseline_file) {
+    ifstream in(baseline_file);
+    string first;
+    if (!in || !getline(in, first))
+      throw bench_error("Failed to open file: " + string(baseline_file));
+    if (first != header)
+      clog << "Warning: the baseline was taken with other fleac options"
+           << (first.starts_with("# fleac") ? ":" + first.substr(7) : "")
+           << endl;
+    in.clear(), in.seekg(0);
+    baseline = read_results(in);
+  }
+  vector<BenchResult> results;
+  for (const auto &preset : presets)
+    for (int32_t size : sizes) {
+      clog << "Measuring " << preset << " " << size << "..." << endl;
+      results.push_back(measure(fleac, options, preset, size, repeat));
+    }
+  if (output) {
+    ofstream out(output);
+    out << header << "\n";
+    write_results(out, results);
+    if (!out)
+      throw bench_error("Failed to write file: " + string(output));
+  }
+  int32_t regressions =
+      report(cout, results, baseline_file ? &baseline : nullptr, threshold);
+  return regressions ? 2 : 0;
+}
+
+int main(int argc, const char *argv[]) try {
+  if (argc >= 2 && !strcmp(argv[1], "gen"))
+    return generate(argc, argv);
+  if (argc >= 3 && !strcmp(argv[1], "run"))
+    return run(argc, argv);
+  cerr << "Usage: " << argv[0]
+       << " gen [--preset=<name>] [--size=<n>] [--seed=<n>] [--funcs=<n>]"
+          " [--stmts=<n>] [--depth=<n>] [--chain=<n>] [--table=<n>]"
+          " [--idents=<n>]\n"
+       << "       " << argv[0]
+       << " run <fleac> [--presets=<name>,...] [--sizes=<n>,...]"
+          " [--repeat=<n>] [--baseline=<file>] [--threshold=<percent>]"
+          " [--output=<file>] [-- <fleac options>]\n"
+       << "Presets:";
+  for (const auto &name : synth_presets())
+    cerr << " " << name;
+  cerr << endl;
+  return 1;
+} catch (const bench_error &e) {
+  cerr << "Error: " << e.what() << endl;
+  return 1;
+}
@@ -1,4 +1,3 @@
 cd fleac
-flex -o flea.lex.cpp flea.l
 bison -d -o flea.tab.cpp flea.y -Wcounterexamples
-clang++ -o fleac flea.tab.cpp flea.lex.cpp flea_ast.cpp flea_expr.cpp flea_sym.cpp main.cpp -g -std=c++20 -Wall -Wextra -Wpedantic -Wconversion -fsanitize=address
+clang++ -o fleac flea.tab.cpp flea_alloc.cpp flea_arena.cpp flea_ast.cpp flea_cache.cpp flea_emit.cpp flea_expr.cpp flea_gen.cpp flea_inline.cpp flea_interp.cpp flea_ir.cpp flea_layout.cpp flea_lex.cpp flea_loop.cpp flea_opt.cpp flea_pool.cpp flea_range.cpp flea_report.cpp flea_run.cpp flea_ssa.cpp flea_sym.cpp flea_tail.cpp main.cpp -g -std=c++20 -Wall -Wextra -Wpedantic -Wconversion -fsanitize=address -DFLUSH_ENABLED -DEXITING_LOG_ENABLED -DLINE_TABLE_ENABLED
@@ -0,0 +1,34 @@
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+struct flight_entry {
+  int32_t line, addr, val;
+};
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    cerr << "Usage: " << argv[0] << " <flight record>" << endl;
+    return 1;
+  }
+  ifstream ifs(argv[1], ios::binary);
+  char magic[4];
+  uint32_t n;
+  if (!ifs.read(magic, 4) || string(magic, 4) != "FLFR" ||
+      !ifs.read((char *)&n, sizeof(n))) {
+    cerr << "Invalid flight record: " << argv[1] << endl;
+    return 1;
+  }
+  for (flight_entry e; n-- && ifs.read((char *)&e, sizeof(e));) {
+    cout << "Line " << e.line;
+    if (e.addr == INT32_MIN)
+      cout << endl;
+    else if (e.addr < 0)
+      cout << ": %r" << -1 - e.addr << "=" << e.val << endl;
+    else
+      cout << ": $" << e.addr << "=" << e.val << endl;
+  }
+  return 0;
+}
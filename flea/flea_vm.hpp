@@ -0,0 +1,811 @@
+#ifndef FLEA_VM_HPP_FLAG
+#define FLEA_VM_HPP_FLAG
+
+// The core of the flea VM: its state, operands and instructions, and the
+// loop that runs them. It defines the state, so a program includes it in
+// one translation unit: flea.cpp for the VM, and fleac to run what it
+// compiles in the same process.
+
+#define time_limit 10000000
+#define memory_size (1 << 23)
+#define register_count 16
+
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef DEBUG_MODE_ENABLED
+#include <unordered_set>
+#endif
+#ifdef EXITING_LOG_ENABLED
+#include <ctime>
+#endif
+#ifdef FORK_SERVER_ENABLED
+#include <fcntl.h>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace flea {
+
+using namespace std;
+
+class interpreted_error : public exception {
+private:
+  const char *msg;
+
+public:
+  interpreted_error(const char *msg) : msg(msg) {}
+  const char *what() const noexcept override { return msg; }
+};
+
+struct code;
+
+int32_t line = -1;
+vector<code> codes;
+vector<string> code_id = {"=",    "+",    "-",    "*",    "/",   "<",  "==",
+                          "if",   "getc", "geti", "putc", "puti", "%",  "!=",
+                          "<=",   ">",    ">=",   "min",  "max",  "&",  "|",
+                          "^",    "<<",   ">>",   "neg",  "!"};
+unordered_map<string, int32_t> code_names = {
+    {"=", 0},     {"+", 1},     {"-", 2},     {"*", 3},     {"/", 4},
+    {"<", 5},     {"==", 6},    {"if", 7},    {"getc", 8},  {"geti", 9},
+    {"putc", 10}, {"puti", 11}, {"%", 12},    {"!=", 13},   {"<=", 14},
+    {">", 15},    {">=", 16},   {"min", 17},  {"max", 18},  {"&", 19},
+    {"|", 20},    {"^", 21},    {"<<", 22},   {">>", 23},   {"neg", 24},
+    {"!", 25}};
+
+#ifdef DEBUG_MODE_ENABLED
+bool breaking, break_all, fast_mode, interpret_debug;
+unordered_set<int32_t> break_ln, break_val, break_mem, break_cmd;
+#endif
+
+int32_t memory[memory_size];
+int32_t regs[register_count];
+
+bool is_whitespace(char c) {
+  switch (c) {
+  case 0:
+  case ' ':
+  case '\t':
+  case '\n':
+  case '\r':
+    return true;
+  default:
+    return false;
+  }
+}
+
+int32_t floor_div(int32_t a, int32_t b) {
+  if (b == 0)
+    throw interpreted_error("Division by zero");
+  div_t r = div(a, b);
+  return r.quot - (r.rem < 0 ? 1 : 0);
+}
+int32_t floor_mod(int32_t a, int32_t b) {
+  return (int32_t)((uint32_t)a - (uint32_t)floor_div(a, b) * (uint32_t)b);
+}
+
+size_t check_tle() {
+  static size_t cnt = 0;
+  if (++cnt > time_limit)
+    throw interpreted_error("Time limit exceeded");
+  return cnt;
+}
+
+#ifdef EXITING_LOG_ENABLED
+clock_t start_time = 0;
+void output_exit_log(int code) {
+  clock_t end_time = clock();
+  clog << "====================" << endl;
+  clog << "The program terminates after running ";
+  clog << check_tle() << " step(s) ";
+  clog << "with exit code " << code << "." << endl;
+  clog << "Time elapsed: ";
+  clog << fixed << setprecision(3);
+  clog << (double)(end_time - start_time) / CLOCKS_PER_SEC << "s" << endl;
+}
+#endif
+
+#ifdef SAMPLE_PROFILE_ENABLED
+void start_sample_profile();
+void output_sample_profile();
+#endif
+
+#ifdef FLIGHT_RECORDER_ENABLED
+#define flight_record_size 4096
+struct flight_entry {
+  int32_t line, addr, val;
+};
+flight_entry flight_log[flight_record_size];
+uint32_t flight_pos = 0;
+string flight_output = "flea.fr";
+inline void flight_step() {
+  flight_log[++flight_pos % flight_record_size] = {line, INT32_MIN, 0};
+}
+inline void flight_write(const int32_t *p, int32_t val) {
+  flight_entry &e = flight_log[flight_pos % flight_record_size];
+  e.addr = regs <= p && p < regs + register_count ? (int32_t)(-1 - (p - regs))
+                                                   : (int32_t)(p - memory);
+  e.val = val;
+}
+void dump_flight_record() {
+  ofstream ofs(flight_output, ios::binary);
+  uint32_t n = min(flight_pos, (uint32_t)flight_record_size);
+  ofs.write("FLFR", 4).write((const char *)&n, sizeof(n));
+  for (uint32_t i = flight_pos - n + 1; i <= flight_pos; ++i)
+    ofs.write((const char *)&flight_log[i % flight_record_size],
+              sizeof(flight_entry));
+  clog << "Flight record (" << n << " step(s)) written to " << flight_output
+       << "." << endl;
+}
+#endif
+
+#ifdef FORK_SERVER_ENABLED
+bool fork_pending = false;
+vector<string> fork_inputs;
+ostringstream fork_prefix;
+streambuf *fork_stdout = nullptr;
+void start_fork_server() {
+  fork_stdout = cout.rdbuf(fork_prefix.rdbuf());
+}
+void fork_server() {
+  fork_pending = false;
+  cout.rdbuf(fork_stdout);
+  string prefix = fork_prefix.str();
+#ifdef EXITING_LOG_ENABLED
+  clock_t elapsed = clock() - start_time;
+#endif
+  for (const string &in : fork_inputs) {
+    clog.flush();
+    pid_t pid = fork();
+    if (pid < 0)
+      throw interpreted_error("Fork failed");
+    if (pid == 0) {
+      int ifd = open(in.c_str(), O_RDONLY);
+      int ofd = open((in + ".out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (ifd < 0 || ofd < 0)
+        throw interpreted_error("Cannot open input file");
+      dup2(ifd, STDIN_FILENO), dup2(ofd, STDOUT_FILENO);
+      close(ifd), close(ofd);
+      cin.clear();
+      cout << prefix;
+#ifdef EXITING_LOG_ENABLED
+      start_time = clock() - elapsed;
+#endif
+      return;
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    clog << in << ": exit code "
+         << (WIFEXITED(status) ? WEXITSTATUS(status) : -1) << endl;
+  }
+  exit(EXIT_SUCCESS);
+}
+#endif
+
+#ifdef LINE_TABLE_ENABLED
+// Where the lines came from, as told by the line table fleac writes: each
+// row covers the lines from its own up to the next row's.
+struct source_row {
+  int32_t line, src_line, func;
+};
+string source_file;
+vector<string> source_funcs;
+vector<source_row> source_rows;
+const source_row *source_of(int32_t ln) {
+  auto it = upper_bound(
+      source_rows.begin(), source_rows.end(), ln,
+      [](int32_t ln, const source_row &r) { return ln < r.line; });
+  return it == source_rows.begin() ? nullptr : &*--it;
+}
+const string &source_func(int32_t func) {
+  static const string none = "?";
+  return 0 <= func && func < (int32_t)source_funcs.size() ? source_funcs[func]
+                                                         : none;
+}
+// " (file:line, in func)" for a line whose source is known.
+ostream &print_source(ostream &os, int32_t ln) {
+  const source_row *r = source_of(ln);
+  if (!r || r->src_line <= 0)
+    return os;
+  return os << " (" << source_file << ":" << r->src_line << ", in "
+            << source_func(r->func) << ")";
+}
+#endif
+
+[[noreturn]] void exit_with_success(int code = EXIT_SUCCESS) {
+#ifdef FORK_SERVER_ENABLED
+  if (fork_pending)
+    fork_server();
+#endif
+#ifdef SAMPLE_PROFILE_ENABLED
+  output_sample_profile();
+#endif
+#ifdef EXITING_LOG_ENABLED
+  output_exit_log(code);
+#endif
+  exit(code);
+}
+[[noreturn]] void exit_with_error(const char *msg) {
+#ifdef FORK_SERVER_ENABLED
+  if (fork_pending)
+    fork_server();
+#endif
+  if (line == -1)
+    clog << msg << endl;
+  else {
+    clog << "Line " << line;
+#ifdef LINE_TABLE_ENABLED
+    print_source(clog, line);
+#endif
+    clog << ": " << msg << endl;
+  }
+#ifdef SAMPLE_PROFILE_ENABLED
+  output_sample_profile();
+#endif
+#ifdef FLIGHT_RECORDER_ENABLED
+  dump_flight_record();
+#endif
+#ifdef EXITING_LOG_ENABLED
+  output_exit_log(EXIT_FAILURE);
+#endif
+  exit(EXIT_FAILURE);
+}
+
+void sigint_handler(int) { exit_with_error("Interrupted by signal"); }
+
+int32_t &get_val(int32_t addr) {
+  if (0 <= addr && addr < memory_size)
+    return memory[addr];
+  throw interpreted_error("Invalid memory access");
+  __builtin_unreachable();
+}
+int32_t &get_pointer(int32_t addr) { return get_val(get_val(addr)); }
+int32_t &get_reg(int32_t r) {
+  if (0 <= r && r < register_count)
+    return regs[r];
+  throw interpreted_error("Invalid register");
+  __builtin_unreachable();
+}
+
+int32_t to_int(const string &s) {
+  try {
+    return stol(s);
+  } catch (invalid_argument &) {
+    throw interpreted_error("Invalid integer");
+  } catch (out_of_range &) {
+    throw interpreted_error("Integer out of range");
+  } catch (...) {
+    throw interpreted_error("Unknown error");
+  }
+  __builtin_unreachable();
+}
+
+int32_t getc(istream &is = cin) { return is.get(); }
+int32_t geti(istream &is = cin) {
+  string s;
+  return is >> s, to_int(s);
+}
+void putc(int32_t a, ostream &os = cout) {
+  os.put((char)a);
+#ifdef FLUSH_ENABLED
+  os.flush();
+#endif
+}
+void puti(int32_t a, ostream &os = cout) {
+  os << a;
+#ifdef FLUSH_ENABLED
+  os.flush();
+#endif
+}
+
+void load_data(istream &is) {
+  int32_t addr = geti(is), n = geti(is);
+  if (addr < 0 || n < 0 || n > memory_size - addr)
+    throw interpreted_error("Invalid data segment");
+  for (int32_t i = 0; i < n; ++i)
+    memory[addr + i] = geti(is);
+}
+
+#ifdef LINE_TABLE_ENABLED
+void load_line_table(istream &is) {
+  source_rows.clear(), source_funcs.clear();
+  for (string key; is >> key;) {
+    if (key == "file")
+      getline(is >> ws, source_file);
+    else if (key == "func")
+      source_funcs.push_back((is >> key, key));
+    else {
+      source_row r{to_int(key), geti(is), geti(is)};
+      if (!source_rows.empty() && r.line <= source_rows.back().line)
+        throw interpreted_error("Invalid line table");
+      source_rows.push_back(r);
+    }
+  }
+}
+#endif
+
+void go_to(int32_t a);
+
+int32_t from_code_name(const string &s) {
+  if (s.size() == 0)
+    return -1;
+  if (code_names.count(s))
+    return code_names[s];
+  throw interpreted_error("Invalid instruction");
+  __builtin_unreachable();
+}
+
+struct value {
+  char type, base_type = 0, idx_type = 0;
+  int32_t val, idx = 0;
+  value() : type('@'), val(INT32_MAX) {}
+  value(int32_t val) : type('@'), val(val) {}
+  value(char type, int32_t val) : type(type), val(val) {
+    switch (type) {
+    case '@':
+    case '$':
+    case '#':
+      break;
+    case '%':
+      get_reg(val);
+      break;
+    default:
+      throw interpreted_error("Invalid value type");
+    }
+  }
+  value(const value &base, const value &idx)
+      : type('['), base_type(base.type), idx_type(idx.type), val(base.val),
+        idx(idx.val) {
+    switch (base_type) {
+    case '$':
+    case '%':
+      break;
+    default:
+      throw interpreted_error("Invalid value type");
+    }
+    switch (idx_type) {
+    case '@':
+    case '$':
+    case '%':
+      break;
+    default:
+      throw interpreted_error("Invalid value type");
+    }
+  }
+  static int32_t fetch(char type, int32_t val) {
+    switch (type) {
+    case '@':
+      return val;
+    case '$':
+      return get_val(val);
+    case '%':
+      return regs[val];
+    default:
+      __builtin_unreachable();
+    }
+  }
+  int32_t &get_index() const {
+    return get_val((int32_t)((uint32_t)fetch(base_type, val) +
+                             (uint32_t)fetch(idx_type, idx)));
+  }
+  int32_t get() const {
+    switch (type) {
+    case '@':
+      return val;
+    case '$':
+      return get_val(val);
+    case '#':
+      return get_pointer(val);
+    case '%':
+      return regs[val];
+    case '[':
+      return get_index();
+    default:
+      __builtin_unreachable();
+    }
+  }
+  int32_t &ref() const {
+    switch (type) {
+    case '@':
+      throw interpreted_error("Cannot assign to a constant");
+    case '$':
+      return get_val(val);
+    case '#':
+      return get_pointer(val);
+    case '%':
+      return regs[val];
+    case '[':
+      return get_index();
+    default:
+      __builtin_unreachable();
+    }
+  }
+  void set(const value &b) const {
+    int32_t x = b.get();
+    int32_t &r = ref();
+    r = x;
+#ifdef FLIGHT_RECORDER_ENABLED
+    flight_write(&r, x);
+#endif
+  }
+#ifdef DEBUG_MODE_ENABLED
+  pair<int32_t, int32_t> get_memory() const {
+    switch (type) {
+    case '@':
+    case '%':
+      return {-1, -1};
+    case '$':
+      return {val, -1};
+    case '#':
+      return {val, get_val(val)};
+    case '[':
+      return {base_type == '$' ? val : -1, (int32_t)(&get_index() - memory)};
+    default:
+      __builtin_unreachable();
+    }
+  }
+  bool check_memory(const unordered_set<int32_t> &addrs) const {
+    auto [addr1, addr2] = get_memory();
+    return addrs.count(addr1) || addrs.count(addr2);
+  }
+  bool check_value(const unordered_set<int32_t> &values) const {
+    return values.count(get());
+  }
+  static ostream &print_operand(ostream &os, char type, int32_t val) {
+    return type == '%' ? os << "%r" << val : os << type << val;
+  }
+  ostream &print(ostream &os) const {
+    if (type != '[')
+      return print_operand(os, type, val);
+    print_operand(os << "[", base_type, val) << "+";
+    return print_operand(os, idx_type, idx) << "]";
+  }
+#endif
+  friend int32_t operator+(const value &a, const value &b) {
+    return (int32_t)((uint32_t)a.get() + (uint32_t)b.get());
+  }
+  friend int32_t operator-(const value &a, const value &b) {
+    return (int32_t)((uint32_t)a.get() - (uint32_t)b.get());
+  }
+  friend int32_t operator*(const value &a, const value &b) {
+    return (int32_t)((uint32_t)a.get() * (uint32_t)b.get());
+  }
+  friend int32_t operator/(const value &a, const value &b) {
+    return floor_div(a.get(), b.get());
+  }
+  friend int32_t operator<(const value &a, const value &b) {
+    return a.get() < b.get() ? 1 : 0;
+  }
+  friend int32_t operator==(const value &a, const value &b) {
+    return a.get() == b.get() ? 1 : 0;
+  }
+  friend int32_t operator%(const value &a, const value &b) {
+    return floor_mod(a.get(), b.get());
+  }
+  friend int32_t operator!=(const value &a, const value &b) {
+    return a.get() != b.get() ? 1 : 0;
+  }
+  friend int32_t operator<=(const value &a, const value &b) {
+    return a.get() <= b.get() ? 1 : 0;
+  }
+  friend int32_t operator>(const value &a, const value &b) {
+    return a.get() > b.get() ? 1 : 0;
+  }
+  friend int32_t operator>=(const value &a, const value &b) {
+    return a.get() >= b.get() ? 1 : 0;
+  }
+  friend int32_t operator&(const value &a, const value &b) {
+    return a.get() & b.get();
+  }
+  friend int32_t operator|(const value &a, const value &b) {
+    return a.get() | b.get();
+  }
+  friend int32_t operator^(const value &a, const value &b) {
+    return a.get() ^ b.get();
+  }
+  friend int32_t operator<<(const value &a, const value &b) {
+    return (int32_t)((uint32_t)a.get() << (b.get() & 31));
+  }
+  friend int32_t operator>>(const value &a, const value &b) {
+    return a.get() >> (b.get() & 31);
+  }
+  friend int32_t operator-(const value &a) {
+    return (int32_t)(0u - (uint32_t)a.get());
+  }
+  friend int32_t operator!(const value &a) { return a.get() ? 0 : 1; }
+#ifdef DEBUG_MODE_ENABLED
+  friend ostream &operator<<(ostream &os, const value &v) {
+    v.print(os);
+    switch (v.type) {
+    case '@':
+      return os;
+    case '$':
+      return os << "=" << get_val(v.val);
+    case '#':
+      return os << "(" << "$" << get_val(v.val) << ")=" << v.get();
+    case '%':
+    case '[':
+      return os << "=" << v.get();
+    }
+    __builtin_unreachable();
+  }
+#endif
+  static value parse(const string &s) {
+    if (s.size() > 1) {
+      switch (s[0]) {
+      case '@':
+      case '$':
+      case '#':
+        return value(s[0], to_int(s.substr(1)));
+      case '%':
+        if (s[1] != 'r')
+          break;
+        return value(s[0], to_int(s.substr(2)));
+      case '[': {
+        size_t p = s.find('+', 1);
+        if (p == string::npos || s.back() != ']')
+          break;
+        return value(parse(s.substr(1, p - 1)),
+                     parse(s.substr(p + 1, s.size() - p - 2)));
+      }
+      }
+    }
+    throw interpreted_error("Invalid value");
+  }
+  friend istream &operator>>(istream &is, value &v) {
+    string s;
+    is >> s;
+    if (s.size() != 1)
+      return v = parse(s), is;
+    int32_t val = geti(is);
+    v = value(s[0], val);
+    return is;
+  }
+};
+
+struct code {
+  int32_t type;
+  value a, b, c;
+  code() : type(-1), a(), b(), c() {}
+  code(int32_t type, value a, value b, value c) { set(type, a, b, c); }
+  void set(int32_t type, value a, value b, value c) {
+    this->type = type, this->a = a, this->b = b, this->c = c;
+    switch (type) {
+    case -1:
+    case 0 ... 25:
+      break;
+    default:
+      throw interpreted_error("Invalid instruction");
+    }
+  }
+#ifdef DEBUG_MODE_ENABLED
+  bool check_value(const unordered_set<int32_t> &values) const {
+    return a.check_value(values) || b.check_value(values) ||
+           c.check_value(values);
+  }
+  bool check_memory(const unordered_set<int32_t> &addrs) const {
+    return a.check_memory(addrs) || b.check_memory(addrs) ||
+           c.check_memory(addrs);
+  }
+  bool check_break() const {
+    return breaking || break_all || break_ln.count(line) ||
+           break_cmd.count(type) || check_value(break_val) ||
+           check_memory(break_mem);
+  }
+#endif
+  void execute() const {
+#ifdef DEBUG_MODE_ENABLED
+    if (check_break()) {
+      clog << "Breakpoint at line " << line;
+#ifdef LINE_TABLE_ENABLED
+      print_source(clog, line);
+#endif
+      clog << ": " << *this << endl;
+      breaking = true, interpret_debug = !fast_mode;
+    }
+#endif
+    switch (type) {
+    case -1:
+      [[unlikely]] throw interpreted_error("End of program");
+    case 0:
+      a.set(b);
+      break;
+    case 1:
+      c.set(a + b);
+      break;
+    case 2:
+      c.set(a - b);
+      break;
+    case 3:
+      c.set(a * b);
+      break;
+    case 4:
+      c.set(a / b);
+      break;
+    case 5:
+      c.set(a < b);
+      break;
+    case 6:
+      c.set(a == b);
+      break;
+    case 7:
+      if (a.get())
+        go_to(b.get());
+      break;
+    case 8:
+#ifdef FORK_SERVER_ENABLED
+      if (fork_pending)
+        fork_server();
+#endif
+      a.set(getc());
+      break;
+    case 9:
+#ifdef FORK_SERVER_ENABLED
+      if (fork_pending)
+        fork_server();
+#endif
+      a.set(geti());
+      break;
+    case 10:
+      putc(a.get());
+      break;
+    case 11:
+      puti(a.get());
+      break;
+    case 12:
+      c.set(a % b);
+      break;
+    case 13:
+      c.set(a != b);
+      break;
+    case 14:
+      c.set(a <= b);
+      break;
+    case 15:
+      c.set(a > b);
+      break;
+    case 16:
+      c.set(a >= b);
+      break;
+    case 17:
+      c.set(min(a.get(), b.get()));
+      break;
+    case 18:
+      c.set(max(a.get(), b.get()));
+      break;
+    case 19:
+      c.set(a & b);
+      break;
+    case 20:
+      c.set(a | b);
+      break;
+    case 21:
+      c.set(a ^ b);
+      break;
+    case 22:
+      c.set(a << b);
+      break;
+    case 23:
+      c.set(a >> b);
+      break;
+    case 24:
+      b.set(-a);
+      break;
+    case 25:
+      b.set(!a);
+      break;
+    default:
+      __builtin_unreachable();
+    }
+  }
+#ifdef DEBUG_MODE_ENABLED
+  friend ostream &operator<<(ostream &os, const code &c) {
+    if (c.type == -1) [[unlikely]]
+      return os;
+    os << code_id[c.type] << " ";
+    switch (c.type) {
+    case 8 ... 11:
+      return os << c.a;
+    case 1 ... 6:
+    case 12 ... 23:
+      return os << c.a << " " << c.b << " " << c.c;
+    case 0:
+    case 7:
+    case 24 ... 25:
+      return os << c.a << " " << c.b;
+    }
+    __builtin_unreachable();
+  }
+#endif
+  friend istream &operator>>(istream &is, code &c) {
+    string type;
+    while (is >> type && type == ".data")
+      load_data(is);
+    if (!is)
+      return is;
+    value x, y, z;
+    int32_t tp = from_code_name(type);
+    switch (tp) {
+    case -1:
+      c = code();
+      break;
+    case 8 ... 11:
+      is >> x, c = code(tp, x, y, z);
+      break;
+    case 1 ... 6:
+    case 12 ... 23:
+      is >> x >> y >> z, c = code(tp, x, y, z);
+      break;
+    case 0:
+    case 7:
+    case 24 ... 25:
+      is >> x >> y, c = code(tp, x, y, z);
+      break;
+    default:
+      __builtin_unreachable();
+    }
+    return is;
+  }
+};
+
+void go_to(int32_t a) {
+  if (a == -1)
+    exit_with_success();
+  if (a < -1) [[unlikely]]
+    exit_with_success(-1 - a);
+  if (0 < a && a <= (int32_t)codes.size())
+    line = a - 1;
+  else
+    throw interpreted_error("Invalid jump");
+}
+
+#ifdef DEBUG_MODE_ENABLED
+void interpret_debug_cmd(const string &s);
+#endif
+
+// Runs codes from the first line. It ends only through the exit functions
+// or an interpreted_error, which the caller passes to exit_with_error.
+[[noreturn]] void run() {
+#ifdef EXITING_LOG_ENABLED
+  start_time = clock();
+#endif
+#ifdef SAMPLE_PROFILE_ENABLED
+  start_sample_profile();
+#endif
+#ifdef FORK_SERVER_ENABLED
+  if (fork_pending)
+    start_fork_server();
+#endif
+  for (line = 1; line <= (int32_t)codes.size(); ++line, check_tle()) {
+#ifdef FLIGHT_RECORDER_ENABLED
+    flight_step();
+#endif
+    codes[line - 1].execute();
+#ifdef DEBUG_MODE_ENABLED
+    if (interpret_debug) {
+      clog << "====Debug====" << endl;
+      while (interpret_debug) {
+        string cmd;
+        getline(cin, cmd);
+        interpret_debug_cmd(cmd);
+      }
+      clog << "=====End=====" << endl;
+    }
+#endif
+  }
+  throw interpreted_error("End of program");
+}
+
+} // namespace flea
+
+#endif // FLEA_VM_HPP_FLAG
@@ -2,6 +2,7 @@
   #include <cassert>
   #include <memory>
   #include <string>
+  #include "flea_ast.hpp"
 }
 
 %{
@@ -15,25 +16,26 @@ extern int yylineno;
 
 int yylex();
 void yyerror(const char *msg, int yylineno);
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *msg);
+void yyerror(std::unique_ptr<CompUnitAST> &ast, const char *msg);
 
 %}
 
-%parse-param { std::unique_ptr<BaseAST> &ast }
+%parse-param { std::unique_ptr<CompUnitAST> &ast }
 
 %union {
   int32_t int_val;
-  std::string *str_val;
+  Ident ident_val;
   BaseAST *ast_val;
-  std::vector<std::unique_ptr<BaseAST>> *list_val;
+  ASTList *list_val;
 }
 
 %token INT VOID CONST RETURN IF ELSE WHILE BREAK CONTINUE LT GT LE GE EQ NE
-%token <str_val> IDENT
+%token <ident_val> IDENT
 %token <int_val> INT_CONST
 
 %type <ast_val> FuncDef FuncFParam
 %type <list_val> BlockItemList VarDefList ConstDefList FuncFParamsList FuncRParamsList
+%type <list_val> DimList IndexList InitValList ConstInitValList
 %type <ast_val> Block Stmt
 %type <ast_val> ExpStmt RetStmt AssignStmt BreakStmt ContinueStmt
 %type <ast_val> OpenStmt ClosedStmt SimpleStmt
@@ -44,56 +46,65 @@ void yyerror(std::unique_ptr<BaseAST> &ast, const char *msg);
 %type <ast_val> Exp ConstExp Number LVal
 %type <ast_val> PrimaryExp UnaryExp MulExp AddExp RelExp EqExp CallExp
 
-%destructor { delete $$; } <str_val>
-%destructor { delete $$; } <ast_val>
-%destructor { delete $$; } <list_val>
-
 %%
 
 CompUnit
   : { ast = std::make_unique<CompUnitAST>(); }
   | CompUnit Decl {
-    dynamic_cast<CompUnitAST *>(ast.get())->insertDecl($2);
+    ast->insertDecl($2);
   }
   | CompUnit FuncDef {
-    dynamic_cast<CompUnitAST *>(ast.get())->insertFunc($2);
+    ast->insertFunc($2);
   }
   ;
 
 FuncDef
   : INT IDENT '(' FuncFParamsList ')' Block {
-    $$ = new FuncDefAST((char)1, $2, $6, $4);
+    $$ = new_ast<FuncDefAST>((char)1, $2, $6, $4);
   }
   | VOID IDENT '(' FuncFParamsList ')' Block {
-    $$ = new FuncDefAST((char)0, $2, $6, $4);
+    $$ = new_ast<FuncDefAST>((char)0, $2, $6, $4);
   }
   ;
 
 FuncFParamsList
-  : { $$ = new std::vector<std::unique_ptr<BaseAST>>; }
+  : { $$ = new_ast_list(); }
   | FuncFParam {
-    auto fp_l = new std::vector<std::unique_ptr<BaseAST>>;
-    fp_l->emplace_back($1);
+    auto fp_l = new_ast_list();
+    fp_l->push_back($1);
     $$ = fp_l;
   }
   | FuncFParamsList ',' FuncFParam {
-    $1->emplace_back($3);
+    $1->push_back($3);
     $$ = $1;
   }
   ;
 
-FuncFParam : INT IDENT { $$ = new FuncFParamAST((char)1, $2); } ;
+FuncFParam
+  : INT IDENT { $$ = new_ast<FuncFParamAST>((char)1, $2); }
+  | INT IDENT '[' ']' DimList {
+    $$ = new_ast<FuncFParamAST>((char)2, $2, $5);
+  }
+  ;
+
+DimList
+  : { $$ = nullptr; }
+  | DimList '[' ConstExp ']' {
+    $$ = $1 ? $1 : new_ast_list();
+    $$->push_back($3);
+  }
+  ;
 
-Block : '{' BlockItemList '}' { $$ = new BlockAST($2); } ;
+Block : '{' BlockItemList '}' { $$ = new_ast<BlockAST>($2); } ;
 
 BlockItem
   : Decl { $$ = $1; }
   | Stmt { $$ = $1; } ;
 
 BlockItemList
-  : { $$ = new std::vector<std::unique_ptr<BaseAST>>; }
+  : { $$ = new_ast_list(); }
   | BlockItemList BlockItem {
-    if ($2) $1->emplace_back($2);
+    if ($2) $1->push_back($2);
     $$ = $1;
   }
   ;
@@ -103,48 +114,80 @@ Decl
   | ConstDecl { $$ = $1; }
   ;
 
-VarDecl : INT VarDefList ';' { $$ = new DeclAST((char)1, $2); }
+VarDecl : INT VarDefList ';' { $$ = new_ast<DeclAST>((char)1, $2); }
 
 VarDef
-  : IDENT {
-    $$ = new DefAST($1);
+  : IDENT DimList {
+    $$ = new_ast<DefAST>($1, nullptr, false, $2);
   }
-  | IDENT '=' InitVal {
-    $$ = new DefAST($1, $3);
+  | IDENT DimList '=' InitVal {
+    $$ = new_ast<DefAST>($1, $4, false, $2);
   }
   ;
 
 VarDefList
   : VarDef {
-    auto def_l = new std::vector<std::unique_ptr<BaseAST>>;
-    def_l->emplace_back($1);
+    auto def_l = new_ast_list();
+    def_l->push_back($1);
     $$ = def_l;
   }
   | VarDefList ',' VarDef {
-    $1->emplace_back($3);
+    $1->push_back($3);
     $$ = $1;
   }
   ;
 
-ConstDecl : CONST INT ConstDefList ';' { $$ = new DeclAST((char)1, $3, true); } ;
+ConstDecl : CONST INT ConstDefList ';' { $$ = new_ast<DeclAST>((char)1, $3, true); } ;
 
-ConstDef : IDENT '=' ConstInitVal { $$ = new DefAST($1, $3, true); } ;
+ConstDef : IDENT DimList '=' ConstInitVal { $$ = new_ast<DefAST>($1, $4, true, $2); } ;
 
 ConstDefList
   : ConstDef {
-    auto def_l = new std::vector<std::unique_ptr<BaseAST>>;
-    def_l->emplace_back($1);
+    auto def_l = new_ast_list();
+    def_l->push_back($1);
     $$ = def_l;
   }
   | ConstDefList ',' ConstDef {
-    $1->emplace_back($3);
+    $1->push_back($3);
+    $$ = $1;
+  }
+  ;
+
+InitVal
+  : Exp { $$ = new_ast<InitValAST>($1); }
+  | '{' '}' { $$ = new_ast<InitValAST>(new_ast_list()); }
+  | '{' InitValList '}' { $$ = new_ast<InitValAST>($2); }
+  ;
+
+InitValList
+  : InitVal {
+    auto init_l = new_ast_list();
+    init_l->push_back($1);
+    $$ = init_l;
+  }
+  | InitValList ',' InitVal {
+    $1->push_back($3);
     $$ = $1;
   }
   ;
 
-InitVal : Exp { $$ = new InitValAST($1); } ;
+ConstInitVal
+  : ConstExp { $$ = new_ast<InitValAST>($1, true); }
+  | '{' '}' { $$ = new_ast<InitValAST>(new_ast_list(), true); }
+  | '{' ConstInitValList '}' { $$ = new_ast<InitValAST>($2, true); }
+  ;
 
-ConstInitVal : ConstExp { $$ = new InitValAST($1, true); } ;
+ConstInitValList
+  : ConstInitVal {
+    auto init_l = new_ast_list();
+    init_l->push_back($1);
+    $$ = init_l;
+  }
+  | ConstInitValList ',' ConstInitVal {
+    $1->push_back($3);
+    $$ = $1;
+  }
+  ;
 
 Stmt
   : OpenStmt { $$ = $1; }
@@ -164,22 +207,22 @@ ClosedStmt
 
 OpenIf
   : IF '(' Exp ')' Stmt {
-    $$ = new IfStmtAST($3, $5);
+    $$ = new_ast<IfStmtAST>($3, $5);
   }
   | IF '(' Exp ')' ClosedStmt ELSE OpenStmt {
-    $$ = new IfStmtAST($3, $5, $7);
+    $$ = new_ast<IfStmtAST>($3, $5, $7);
   }
   ;
 
 ClosedIf
   : IF '(' Exp ')' ClosedStmt ELSE ClosedStmt {
-    $$ = new IfStmtAST($3, $5, $7);
+    $$ = new_ast<IfStmtAST>($3, $5, $7);
   }
   ;
 
-OpenWhile : WHILE '(' Exp ')' OpenStmt { $$ = new WhileStmtAST($3, $5); } ;
+OpenWhile : WHILE '(' Exp ')' OpenStmt { $$ = new_ast<WhileStmtAST>($3, $5); } ;
 
-ClosedWhile : WHILE '(' Exp ')' ClosedStmt { $$ = new WhileStmtAST($3, $5); } ;
+ClosedWhile : WHILE '(' Exp ')' ClosedStmt { $$ = new_ast<WhileStmtAST>($3, $5); } ;
 
 SimpleStmt
   : ';' { $$ = nullptr; }
@@ -191,78 +234,93 @@ SimpleStmt
   | AssignStmt { $$ = $1; }
   ;
 
-BreakStmt : BREAK ';' { $$ = new BreakStmtAST(); } ;
+BreakStmt : BREAK ';' { $$ = new_ast<BreakStmtAST>(); } ;
 
-ContinueStmt : CONTINUE ';' { $$ = new ContinueStmtAST(); } ;
+ContinueStmt : CONTINUE ';' { $$ = new_ast<ContinueStmtAST>(); } ;
 
-RetStmt : RETURN Exp ';' { $$ = new RetStmtAST($2); } ;
+RetStmt : RETURN Exp ';' { $$ = new_ast<RetStmtAST>($2); } ;
 
-ExpStmt : Exp ';' { $$ = new ExpStmtAST($1); } ;
+ExpStmt : Exp ';' { $$ = new_ast<ExpStmtAST>($1); } ;
 
-AssignStmt : LVal '=' Exp ';' { $$ = new AssignStmtAST($1, $3); } ;
+AssignStmt : LVal '=' Exp ';' { $$ = new_ast<AssignStmtAST>($1, $3); } ;
 
-Exp : EqExp { $$ = new ExpAST($1); } ;
+Exp : EqExp { $$ = new_ast<ExpAST>($1); } ;
 
-ConstExp : Exp { $$ = new ExpAST($1, true); } ;
+ConstExp : Exp { $$ = new_ast<ExpAST>($1, true); } ;
 
-LVal : IDENT { $$ = new LValAST($1); } ;
+LVal
+  : IDENT { $$ = new_ast<LValAST>($1); }
+  | IDENT IndexList { $$ = new_ast<LValAST>($1, $2); }
+  ;
+
+IndexList
+  : '[' Exp ']' {
+    auto index_l = new_ast_list();
+    index_l->push_back($2);
+    $$ = index_l;
+  }
+  | IndexList '[' Exp ']' {
+    $1->push_back($3);
+    $$ = $1;
+  }
+  ;
 
-Number : INT_CONST { $$ = new NumberAST($1); } ;
+Number : INT_CONST { $$ = new_ast<NumberAST>($1); } ;
 
-CallExp : IDENT '(' FuncRParamsList ')' { $$ = new CallExpAST($1, $3); } ;
+CallExp : IDENT '(' FuncRParamsList ')' { $$ = new_ast<CallExpAST>($1, $3); } ;
 
 FuncRParamsList
-  : { $$ = new std::vector<std::unique_ptr<BaseAST>>; }
+  : { $$ = new_ast_list(); }
   | Exp {
-    auto fp_l = new std::vector<std::unique_ptr<BaseAST>>;
-    fp_l->emplace_back($1);
+    auto fp_l = new_ast_list();
+    fp_l->push_back($1);
     $$ = fp_l;
   }
   | FuncRParamsList ',' Exp {
-    $1->emplace_back($3);
+    $1->push_back($3);
     $$ = $1;
   }
   ;
 
 PrimaryExp
-  : '(' Exp ')' { $$ = new PrimaryExpAST($2); }
+  : '(' Exp ')' { $$ = new_ast<PrimaryExpAST>($2); }
   | LVal { $$ = $1; }
   | Number { $$ = $1; }
   | CallExp { $$ = $1; }
   ;
 
 UnaryExp
-  : PrimaryExp { $$ = new UnaryExpAST(0, $1); }
-  | '+' UnaryExp { $$ = new UnaryExpAST('+', $2); }
-  | '-' UnaryExp { $$ = new UnaryExpAST('-', $2); }
-  | '!' UnaryExp { $$ = new UnaryExpAST('!', $2); }
+  : PrimaryExp { $$ = new_ast<UnaryExpAST>((char)0, $1); }
+  | '+' UnaryExp { $$ = new_ast<UnaryExpAST>('+', $2); }
+  | '-' UnaryExp { $$ = new_ast<UnaryExpAST>('-', $2); }
+  | '!' UnaryExp { $$ = new_ast<UnaryExpAST>('!', $2); }
   ;
 
 MulExp
-  : UnaryExp { $$ = new MulExpAST(0, $1); }
-  | MulExp '*' UnaryExp { $$ = new MulExpAST('*', $1, $3); }
-  | MulExp '/' UnaryExp { $$ = new MulExpAST('/', $1, $3); }
-  | MulExp '%' UnaryExp { $$ = new MulExpAST('%', $1, $3); }
+  : UnaryExp { $$ = new_ast<MulExpAST>((char)0, $1); }
+  | MulExp '*' UnaryExp { $$ = new_ast<MulExpAST>('*', $1, $3); }
+  | MulExp '/' UnaryExp { $$ = new_ast<MulExpAST>('/', $1, $3); }
+  | MulExp '%' UnaryExp { $$ = new_ast<MulExpAST>('%', $1, $3); }
   ;
 
 AddExp
-  : MulExp { $$ = new AddExpAST(0, $1); }
-  | AddExp '+' MulExp { $$ = new AddExpAST('+', $1, $3); }
-  | AddExp '-' MulExp { $$ = new AddExpAST('-', $1, $3); }
+  : MulExp { $$ = new_ast<AddExpAST>((char)0, $1); }
+  | AddExp '+' MulExp { $$ = new_ast<AddExpAST>('+', $1, $3); }
+  | AddExp '-' MulExp { $$ = new_ast<AddExpAST>('-', $1, $3); }
   ;
 
 RelExp
-  : AddExp { $$ = new RelExpAST(0, $1); }
-  | RelExp LT AddExp { $$ = new AddExpAST('<', $1, $3); }
-  | RelExp GT AddExp { $$ = new AddExpAST('>', $1, $3); }
-  | RelExp LE AddExp { $$ = new AddExpAST('l', $1, $3); }
-  | RelExp GE AddExp { $$ = new AddExpAST('g', $1, $3); }
+  : AddExp { $$ = new_ast<RelExpAST>((char)0, $1); }
+  | RelExp LT AddExp { $$ = new_ast<AddExpAST>('<', $1, $3); }
+  | RelExp GT AddExp { $$ = new_ast<AddExpAST>('>', $1, $3); }
+  | RelExp LE AddExp { $$ = new_ast<AddExpAST>('l', $1, $3); }
+  | RelExp GE AddExp { $$ = new_ast<AddExpAST>('g', $1, $3); }
   ;
 
 EqExp
-  : RelExp { $$ = new EqExpAST(0, $1); }
-  | EqExp EQ RelExp { $$ = new EqExpAST('e', $1, $3); }
-  | EqExp NE RelExp { $$ = new EqExpAST('n', $1, $3); }
+  : RelExp { $$ = new_ast<EqExpAST>((char)0, $1); }
+  | EqExp EQ RelExp { $$ = new_ast<EqExpAST>('e', $1, $3); }
+  | EqExp NE RelExp { $$ = new_ast<EqExpAST>('n', $1, $3); }
   ;
 
 %%
@@ -271,6 +329,7 @@ void yyerror(const char *msg, int lineno) {
   std::cerr << "Error at line " << lineno << ": " << msg << std::endl;
 }
 
-void yyerror([[maybe_unused]] std::unique_ptr<BaseAST> &ast, const char *msg) {
+void yyerror([[maybe_unused]] std::unique_ptr<CompUnitAST> &ast,
+             const char *msg) {
   yyerror(msg, yylineno);
 }
\ No newline at end of file
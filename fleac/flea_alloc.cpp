@@ -0,0 +1,229 @@
+#include "flea_alloc.hpp"
+#include <algorithm>
+#include <map>
+#include <numeric>
+
+// A live range is a list of disjoint half-open position intervals, sorted.
+// Instruction p reads its operands at 2p and writes its result at 2p + 1,
+// so a value dying at p and one born at p may share a home.
+using Ranges = std::vector<std::pair<int32_t, int32_t>>;
+
+// Whether two live ranges share a position; the pieces that end before the
+// other range starts are skipped by binary search.
+static bool overlap(const Ranges &x, const Ranges &y) {
+  if (x.empty() || y.empty())
+    return false;
+  auto i = static_cast<size_t>(
+      std::partition_point(x.begin(), x.end(),
+                           [&](const auto &r) {
+                             return r.second <= y.front().first;
+                           }) -
+      x.begin());
+  auto j = static_cast<size_t>(
+      std::partition_point(y.begin(), y.end(),
+                           [&](const auto &r) {
+                             return r.second <= x.front().first;
+                           }) -
+      y.begin());
+  while (i < x.size() && j < y.size()) {
+    if (x[i].first < y[j].second && y[j].first < x[i].second)
+      return true;
+    x[i].second < y[j].second ? ++i : ++j;
+  }
+  return false;
+}
+
+// Joins the sorted pieces that touch or overlap.
+static void compact(Ranges &r) {
+  size_t k = 0;
+  for (size_t i = 1; i < r.size(); ++i)
+    if (r[i].first <= r[k].second)
+      r[k].second = std::max(r[k].second, r[i].second);
+    else
+      r[++k] = r[i];
+  r.resize(r.empty() ? 0 : k + 1);
+}
+
+static void merge(Ranges &into, const Ranges &from) {
+  auto mid = static_cast<std::ptrdiff_t>(into.size());
+  into.insert(into.end(), from.begin(), from.end());
+  std::inplace_merge(into.begin(), into.begin() + mid, into.end());
+  compact(into);
+}
+
+// The pieces of the ranges a home holds, start to end. Ranges are packed
+// in order of their start, so the pieces ending before the range being
+// packed starts can no longer conflict and are dropped as the scan goes.
+using Held = std::map<int32_t, int32_t>;
+
+static bool conflicts(Held &held, const Ranges &r) {
+  while (!held.empty() && held.begin()->second <= r.front().first)
+    held.erase(held.begin());
+  for (const auto &[begin, end] : r) {
+    auto next = held.lower_bound(end);
+    if (next != held.begin() && std::prev(next)->second > begin)
+      return true;
+  }
+  return false;
+}
+
+static void hold(Held &held, const Ranges &r) {
+  for (const auto &piece : r)
+    held.insert(piece);
+}
+
+// The temporaries live at the end of each block, in increasing order. Each
+// temporary is followed back from the blocks that read it before writing
+// it through the predecessors up to the blocks that write it, so the work
+// is in proportion to where temporaries are live, not blocks by temps.
+static std::vector<std::vector<int32_t>> live_out(const Function &func) {
+  auto n = static_cast<int32_t>(func.blocks.size());
+  std::vector<std::vector<int32_t>> preds(n), out(n), uses(func.ntemps),
+      defs(func.ntemps);
+  std::vector<int32_t> defined(func.ntemps, -1), read(func.ntemps, -1);
+  for (int32_t b = 0; b < n; ++b) {
+    const Block &block = func.blocks[b];
+    for (int32_t k = 0; k < block.succ_count(); ++k)
+      preds[block.succ[k]].push_back(b);
+    auto use = [&](const Operand &opd) {
+      if (opd.is_temp() && defined[opd.val] != b && read[opd.val] != b)
+        read[opd.val] = b, uses[opd.val].push_back(b);
+    };
+    for (const auto &inst : block.insts) {
+      use(inst.a), use(inst.b);
+      for (const auto &arg : inst.args)
+        use(arg);
+      if (inst.dst.is_temp() && defined[inst.dst.val] != b)
+        defined[inst.dst.val] = b, defs[inst.dst.val].push_back(b);
+    }
+    use(block.cond);
+  }
+  std::vector<int32_t> def_mark(n, -1), in_mark(n, -1), out_mark(n, -1);
+  for (int32_t t = 0; t < func.ntemps; ++t) {
+    for (int32_t b : defs[t])
+      def_mark[b] = t;
+    std::vector<int32_t> &work = uses[t];
+    for (int32_t b : work)
+      in_mark[b] = t;
+    while (!work.empty()) {
+      int32_t b = work.back();
+      work.pop_back();
+      for (int32_t p : preds[b]) {
+        if (out_mark[p] != t)
+          out_mark[p] = t, out[p].push_back(t);
+        if (def_mark[p] != t && in_mark[p] != t)
+          in_mark[p] = t, work.push_back(p);
+      }
+    }
+  }
+  return out;
+}
+
+std::vector<Home> allocate(const Function &func, int32_t first_slot,
+                           int32_t &frame) {
+  auto ntemps = static_cast<size_t>(func.ntemps);
+  std::vector<std::vector<int32_t>> out = live_out(func);
+  std::vector<Ranges> ranges(ntemps);
+  std::vector<int32_t> calls, touched;
+  std::vector<char> live(ntemps);
+  int32_t pos = 0;
+  for (size_t b = 0; b < func.blocks.size(); ++b) {
+    const Block &block = func.blocks[b];
+    int32_t start = 2 * pos;
+    pos += static_cast<int32_t>(block.insts.size()) + 1;
+    touched = out[b];
+    for (int32_t t : touched)
+      live[t] = 1, ranges[t].emplace_back(start, 2 * pos);
+    auto use = [&](const Operand &opd, int32_t p) {
+      if (opd.is_temp() && !live[opd.val]) {
+        live[opd.val] = 1, touched.push_back(opd.val);
+        ranges[opd.val].emplace_back(start, 2 * p + 1);
+      }
+    };
+    int32_t p = pos - 1;
+    use(block.cond, p);
+    for (size_t i = block.insts.size(); i-- > 0;) {
+      const Inst &inst = block.insts[i];
+      --p;
+      if (inst.op == Op::CALL)
+        calls.push_back(2 * p + 1);
+      if (inst.dst.is_temp()) {
+        auto t = inst.dst.val;
+        if (live[t])
+          ranges[t].back().first = 2 * p + 1, live[t] = 0;
+        else
+          ranges[t].emplace_back(2 * p + 1, 2 * p + 2);
+      }
+      use(inst.a, p), use(inst.b, p);
+      for (const auto &arg : inst.args)
+        use(arg, p);
+    }
+    for (int32_t t : touched)
+      live[t] = 0;
+  }
+  for (auto &r : ranges)
+    std::sort(r.begin(), r.end()), compact(r);
+  std::sort(calls.begin(), calls.end());
+
+  // coalesce the two sides of a copy into one class, at most one of which
+  // may be a parameter since those have fixed homes
+  std::vector<int32_t> leader(ntemps);
+  std::iota(leader.begin(), leader.end(), 0);
+  auto find = [&](int32_t t) {
+    while (leader[t] != t)
+      t = leader[t] = leader[leader[t]];
+    return t;
+  };
+  for (const auto &block : func.blocks)
+    for (const auto &inst : block.insts) {
+      if (inst.op != Op::MOV || !inst.dst.is_temp() || !inst.a.is_temp())
+        continue;
+      int32_t x = find(inst.dst.val), y = find(inst.a.val);
+      if (x == y || (x < func.nparams && y < func.nparams) ||
+          overlap(ranges[x], ranges[y]))
+        continue;
+      if (y < x)
+        std::swap(x, y);
+      leader[y] = x;
+      merge(ranges[x], ranges[y]);
+    }
+
+  std::vector<int32_t> order;
+  for (int32_t t = func.nparams; t < func.ntemps; ++t)
+    if (find(t) == t && !ranges[t].empty())
+      order.push_back(t);
+  std::sort(order.begin(), order.end(), [&](int32_t x, int32_t y) {
+    return ranges[x].front() < ranges[y].front();
+  });
+  std::vector<Home> homes(ntemps);
+  std::vector<Held> regs(register_count), slots;
+  frame = first_slot;
+  for (int32_t t : order) {
+    bool across_call =
+        std::any_of(ranges[t].begin(), ranges[t].end(), [&](const auto &r) {
+          auto c = std::upper_bound(calls.begin(), calls.end(), r.first);
+          return c != calls.end() && *c < r.second;
+        });
+    Home &home = homes[t];
+    for (int32_t r = first_free_reg; !across_call && r < register_count; ++r)
+      if (!conflicts(regs[r], ranges[t])) {
+        home.reg = r, hold(regs[r], ranges[t]);
+        break;
+      }
+    if (home.reg != -1)
+      continue;
+    size_t s = 0;
+    while (s < slots.size() && conflicts(slots[s], ranges[t]))
+      ++s;
+    if (s == slots.size())
+      slots.emplace_back();
+    hold(slots[s], ranges[t]);
+    home.slot = first_slot + static_cast<int32_t>(s);
+    frame = std::max(frame, home.slot + 1);
+  }
+  for (int32_t t = 0; t < func.nparams; ++t)
+    homes[t].slot = -1 - t;
+  for (int32_t t = func.nparams; t < func.ntemps; ++t)
+    homes[t] = homes[find(t)];
+  return homes;
+}
@@ -0,0 +1,25 @@
+#ifndef FLEA_ALLOC_HPP_FLAG
+#define FLEA_ALLOC_HPP_FLAG
+
+#include "flea_ir.hpp"
+#include <vector>
+
+// Registers %r3 .. %r15 are free for temporaries; %r0 .. %r2 belong to the
+// calling convention and calls clobber all of them.
+constexpr int32_t first_free_reg = 3;
+constexpr int32_t register_count = 16;
+
+// Home of a temporary: register %r<reg> if reg is set, else the frame slot
+// [%r0+@slot]. Parameters keep their incoming slots -1-i.
+struct Home {
+  int32_t reg = -1, slot = 0;
+};
+
+// Computes live ranges over the block order of func, coalesces copies whose
+// ranges do not interfere, and packs the temporaries into registers when
+// they are not live across a call and into frame slots from first_slot
+// otherwise. frame is set to the number of slots in use.
+std::vector<Home> allocate(const Function &func, int32_t first_slot,
+                           int32_t &frame);
+
+#endif // FLEA_ALLOC_HPP_FLAG
@@ -0,0 +1,24 @@
+#include "flea_arena.hpp"
+
+Arena::~Arena() {
+  for (auto it = dtors.rbegin(); it != dtors.rend(); ++it)
+    it->second(it->first);
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+  auto pad = static_cast<size_t>(-reinterpret_cast<uintptr_t>(cur)) &
+             (align - 1);
+  if (!cur || size + pad > static_cast<size_t>(end - cur)) {
+    // an object bigger than a chunk gets one of its own, which leaves the
+    // current chunk open for the next small one
+    if (size > chunk_size / 4) {
+      chunks.emplace_back(new char[size]);
+      return chunks.back().get();
+    }
+    chunks.emplace_back(new char[chunk_size]);
+    cur = chunks.back().get(), end = cur + chunk_size, pad = 0;
+  }
+  void *obj = cur + pad;
+  cur += pad + size;
+  return obj;
+}
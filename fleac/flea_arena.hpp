@@ -0,0 +1,67 @@
+#ifndef FLEA_ARENA_HPP_FLAG
+#define FLEA_ARENA_HPP_FLAG
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump-pointer allocator: objects are carved out of large chunks and freed
+// all at once with the arena. The few objects with non-trivial destructors
+// have them run then, newest first.
+class Arena {
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena();
+  void *allocate(size_t size, size_t align);
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    T *obj = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    if constexpr (!std::is_trivially_destructible_v<T>)
+      dtors.emplace_back(obj, [](void *p) { static_cast<T *>(p)->~T(); });
+    return obj;
+  }
+
+private:
+  static constexpr size_t chunk_size = 64 << 10;
+  std::vector<std::unique_ptr<char[]>> chunks;
+  char *cur = nullptr, *end = nullptr;
+  std::vector<std::pair<void *, void (*)(void *)>> dtors;
+};
+
+// A growable array in an arena; storage it outgrows stays in the arena.
+template <typename T> class ArenaList {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+  ArenaList(Arena &arena) : arena(&arena) {}
+  void push_back(T item) {
+    if (count == capacity)
+      grow();
+    items[count++] = item;
+  }
+  size_t size() const { return count; }
+  bool empty() const { return !count; }
+  T &operator[](size_t i) const { return items[i]; }
+  T *begin() const { return items; }
+  T *end() const { return items + count; }
+
+private:
+  Arena *arena;
+  T *items = nullptr;
+  uint32_t count = 0, capacity = 0;
+  void grow() {
+    capacity = capacity ? 2 * capacity : 4;
+    T *next = static_cast<T *>(arena->allocate(capacity * sizeof(T), alignof(T)));
+    std::copy(items, items + count, next);
+    items = next;
+  }
+};
+
+#endif // FLEA_ARENA_HPP_FLAG
@@ -1,24 +1,44 @@
 #include "flea_ast.hpp"
 #include "flea_expr.hpp"
+#include "flea_interp.hpp"
 #include <cassert>
 
+thread_local Arena *ast_arena = nullptr;
+
+// Where the folds made while checking a function on this thread wait until
+// all functions are checked, as calls run at compile time may be reading
+// any function meanwhile; null to fold right away.
+static thread_local std::vector<std::pair<BaseAST **, BaseAST *>> *ast_folds =
+    nullptr;
+
+CompUnitAST::CompUnitAST() {
+  ast_arena = &arena;
+  const char int_t = static_cast<char>(INT), void_t = static_cast<char>(VOID);
+  stb.insertFunc(Ident::intern("getint"), FuncSign(int_t, {}));
+  stb.insertFunc(Ident::intern("getch"), FuncSign(int_t, {}));
+  stb.insertFunc(Ident::intern("putint"), FuncSign(void_t, {int_t}));
+  stb.insertFunc(Ident::intern("putch"), FuncSign(void_t, {int_t}));
+}
+
 void CompUnitAST::insertDecl(BaseAST *decl) {
+  TimeReport::Timer timer("declarations");
   auto decl_ast = dynamic_cast<DeclAST *>(decl);
   decl_ast->const_eval(&stb);
   decl_l.emplace_back(decl);
 }
 
 void CompUnitAST::insertFunc(BaseAST *func_def) {
+  TimeReport::Timer timer("declarations");
   auto func_def_ast = dynamic_cast<FuncDefAST *>(func_def);
   assert(func_def_ast);
   std::vector<char> arg_types;
   for (const auto &fparam : *func_def_ast->fparam_l) {
-    auto fparam_ast = dynamic_cast<FuncFParamAST *>(fparam.get());
+    auto fparam_ast = dynamic_cast<FuncFParamAST *>(fparam);
     assert(fparam_ast);
     arg_types.push_back(fparam_ast->type_id);
   }
-  FuncSign func_sign(func_def_ast->func_type_id, arg_types);
-  stb.insertFunc(*func_def_ast->ident, func_sign);
+  FuncSign func_sign(func_def_ast->func_type_id, arg_types, func_def);
+  stb.insertFunc(func_def_ast->ident, func_sign);
   func_def_l.emplace_back(func_def);
 }
 
@@ -44,7 +64,14 @@ void FuncDefAST::print(std::ostream &out) const {
 }
 
 void FuncFParamAST::print(std::ostream &out) const {
-  out << id2tp(type_id) << ' ' << *ident;
+  if (type_id != static_cast<char>(ARR)) {
+    out << id2tp(type_id) << ' ' << *ident;
+    return;
+  }
+  out << id2tp(static_cast<char>(INT)) << ' ' << *ident << "[]";
+  if (dim_l)
+    for (const auto &dim : *dim_l)
+      dim->print(out << '['), out << ']';
 }
 
 void BlockAST::print(std::ostream &out) const {
@@ -71,11 +98,24 @@ void DeclAST::print(std::ostream &out) const {
 
 void DefAST::print(std::ostream &out) const {
   out << *ident;
+  if (dim_l)
+    for (const auto &dim : *dim_l)
+      dim->print(out << '['), out << ']';
   if (init_val)
     out << " = ", init_val->print(out);
 }
 
-void InitValAST::print(std::ostream &out) const { exp->print(out); }
+void InitValAST::print(std::ostream &out) const {
+  if (!init_l)
+    return exp->print(out);
+  out << "{";
+  for (size_t i = 0; i < init_l->size(); ++i) {
+    if (i != 0)
+      out << ", ";
+    (*init_l)[i]->print(out);
+  }
+  out << "}";
+}
 
 // void StmtAST::print(std::ostream &out) const { stmt->print(out); }
 
@@ -130,7 +170,12 @@ void PrimaryExpAST::print(std::ostream &out) const {
   out << ")";
 }
 
-void LValAST::print(std::ostream &out) const { out << *ident; }
+void LValAST::print(std::ostream &out) const {
+  out << *ident;
+  if (index_l)
+    for (const auto &index : *index_l)
+      index->print(out << '['), out << ']';
+}
 
 void NumberAST::print(std::ostream &out) const { out << number; }
 
@@ -202,23 +247,96 @@ inline uint64_t get_type(int64_t val) {
   return INT;
 }
 
-int64_t fold_const(std::unique_ptr<BaseAST> &ast, SymbolTable *stb,
-                   uint64_t context) {
+int64_t fold_const(BaseAST *&ast, SymbolTable *stb, uint64_t context) {
   int64_t val = ast->const_eval(stb, context);
   if (check_force(context))
     assert(check_const(val));
   if (!check_const(val))
     return val;
-  ast.reset(new NumberAST((int32_t)val));
+  BaseAST *num = new_ast<NumberAST>((int32_t)val);
+  if (ast_folds)
+    ast_folds->emplace_back(&ast, num);
+  else
+    ast = num;
   return val;
 }
 
-int64_t CompUnitAST::const_eval(SymbolTable *stb, uint64_t context) {
-  stb = &this->stb;
-  for (const auto &func_def : func_def_l) {
-    SymbolTable new_stb(stb);
-    func_def->const_eval(&new_stb, context);
+// Folds the dimensions of an array, which must be positive constants whose
+// product fits in the address space.
+static void fold_dims(ASTList *dim_l, SymbolTable *stb, uint64_t context,
+                      std::vector<int32_t> &dims) {
+  set_force(context);
+  int64_t size = 1;
+  for (auto &dim : *dim_l) {
+    int64_t val = fold_const(dim, stb, context);
+    check_and_raise(val);
+    if (val <= 0)
+      throw flea_compiler_error("array size must be positive");
+    if ((size *= val) > INT32_MAX)
+      throw flea_compiler_error("array too large");
+    dims.push_back(static_cast<int32_t>(val));
   }
+}
+
+// Lays the braced initializer of the sub-array of array at level out from
+// element begin on, row-major: an expression takes the next element, and a
+// nested list fills the largest sub-array whose start the next element is
+// at, the elements it leaves out being zero.
+static void flatten(const InitValAST *init, const ArrayInfo &array,
+                    size_t level, int64_t begin, ArenaList<InitElem> &elems) {
+  auto size_at = [&](size_t d) {
+    return d ? array.stride(d - 1) : array.size();
+  };
+  int64_t pos = begin, end = begin + size_at(level);
+  for (const auto &item : *init->init_l) {
+    auto val = dynamic_cast<InitValAST *>(item);
+    assert(val);
+    if (pos == end)
+      throw flea_compiler_error("excess elements in array initializer");
+    if (!val->init_l) {
+      elems.push_back({pos++, val});
+      continue;
+    }
+    size_t sub = level + 1;
+    while (sub < array.dims.size() && (pos - begin) % size_at(sub))
+      ++sub;
+    if (sub == array.dims.size())
+      throw flea_compiler_error("braces around scalar initializer");
+    flatten(val, array, sub, pos, elems);
+    pos += size_at(sub);
+  }
+}
+
+int64_t CompUnitAST::const_eval([[maybe_unused]] SymbolTable *stb,
+                                uint64_t context) {
+  unsigned workers = pool ? pool->size() : 1;
+  std::vector<SymbolTable> stbs(workers, this->stb);
+  while (worker_arenas.size() < workers)
+    worker_arenas.emplace_back();
+  std::vector<std::vector<std::pair<BaseAST **, BaseAST *>>> folds(
+      func_def_l.size());
+  auto check = [&](unsigned worker, size_t i) {
+    ast_arena = &worker_arenas[worker];
+    ast_folds = &folds[i];
+    Interp::forget();
+    stbs[worker].push();
+    func_def_l[i]->const_eval(&stbs[worker], context);
+    stbs[worker].pop();
+  };
+  try {
+    if (pool)
+      pool->run(func_def_l.size(), check);
+    else
+      for (size_t i = 0; i < func_def_l.size(); ++i)
+        check(0, i);
+  } catch (...) {
+    ast_arena = &arena, ast_folds = nullptr;
+    throw;
+  }
+  ast_arena = &arena, ast_folds = nullptr;
+  for (const auto &func_folds : folds)
+    for (auto [slot, num] : func_folds)
+      *slot = num;
   return VOID_VAR;
 }
 
@@ -232,14 +350,23 @@ int64_t FuncDefAST::const_eval(SymbolTable *stb, uint64_t context) {
 
 int64_t FuncFParamAST::const_eval(SymbolTable *stb, uint64_t context) {
   int64_t offset = static_cast<int64_t>(context >> 32) + 1;
-  stb->insertVar(*ident, -offset);
+  if (type_id != static_cast<char>(ARR)) {
+    stb->insertVar(ident, -offset);
+    return VOID_VAR;
+  }
+  array = ast_arena->make<ArrayInfo>();
+  array->dims.push_back(0);
+  if (dim_l)
+    fold_dims(dim_l, stb, context, array->dims);
+  stb->insertArray(ident, array, -offset);
   return VOID_VAR;
 }
 
 int64_t BlockAST::const_eval(SymbolTable *stb, uint64_t context) {
-  SymbolTable new_stb(stb);
+  stb->push();
   for (const auto &item : *item_l)
-    item->const_eval(&new_stb, context);
+    item->const_eval(stb, context);
+  stb->pop();
   return VOID_VAR;
 }
 
@@ -261,15 +388,40 @@ int64_t DefAST::const_eval(SymbolTable *stb, uint64_t context) {
     return VOID_VAR;
   if (is_const)
     set_force(context);
+  if (dim_l) {
+    array = ast_arena->make<ArrayInfo>();
+    fold_dims(dim_l, stb, context, array->dims);
+    array->is_const = is_const;
+    if (is_const)
+      array->values.assign(static_cast<size_t>(array->size()), 0);
+    if (init_val) {
+      auto init = dynamic_cast<InitValAST *>(init_val);
+      assert(init);
+      if (!init->init_l)
+        throw flea_compiler_error("array initializer must be a braced list");
+      elems = ast_arena->make<ArenaList<InitElem>>(*ast_arena);
+      flatten(init, *array, 0, 0, *elems);
+      for (const auto &elem : *elems) {
+        int64_t val = elem.init->const_eval(stb, context);
+        if (is_const)
+          array->values[static_cast<size_t>(elem.index)] =
+              static_cast<int32_t>(val);
+      }
+    }
+    stb->insertArray(ident, array);
+    return VOID_VAR;
+  }
   int64_t val = init_val ? fold_const(init_val, stb, context) : VOID_VAR;
   if (is_const)
-    stb->insertConst(*ident, static_cast<int32_t>(val));
+    stb->insertConst(ident, static_cast<int32_t>(val));
   else
-    stb->insertVar(*ident);
+    stb->insertVar(ident);
   return VOID_VAR;
 }
 
 int64_t InitValAST::const_eval(SymbolTable *stb, uint64_t context) {
+  if (init_l)
+    throw flea_compiler_error("braced initializer for a scalar");
   if (is_const)
     set_force(context);
   int64_t val = fold_const(exp, stb, context);
@@ -289,10 +441,12 @@ int64_t ExpStmtAST::const_eval(SymbolTable *stb, uint64_t context) {
 int64_t AssignStmtAST::const_eval(SymbolTable *stb, uint64_t context) {
   if (!stb)
     return VOID_VAR;
-  auto lval = dynamic_cast<LValAST *>(this->lval.get());
+  auto lval = dynamic_cast<LValAST *>(this->lval);
   assert(lval);
   if (lval->is_const(stb))
     throw flea_compiler_error("cannot assign to const");
+  if (get_type(lval->const_eval(stb, context)) != INT)
+    throw flea_compiler_error("assignment to array");
   fold_const(exp, stb, context);
   return VOID_VAR;
 }
@@ -348,13 +502,42 @@ int64_t PrimaryExpAST::const_eval(SymbolTable *stb, uint64_t context) {
 int64_t LValAST::const_eval(SymbolTable *stb, uint64_t context) {
   if (!stb)
     return INT_VAR;
-  try {
-    return stb->lookupConst(*ident);
-  } catch (const flea_compiler_error &) {
-    if (check_force(context))
-      throw;
-    return stb->lookup(*ident), INT_VAR;
+  const Symbol &sym = stb->lookup(ident);
+  if (sym.array)
+    return const_eval(stb, context, *sym.array);
+  if (index_l)
+    throw flea_compiler_error("subscripted value is not an array");
+  if (sym.kind == Symbol::CONST)
+    return sym.value;
+  if (sym.kind == Symbol::NONE)
+    throw undeclared_error(*ident);
+  if (check_force(context))
+    throw not_const_error(*ident);
+  return INT_VAR;
+}
+
+// Fewer subscripts than dimensions select a sub-array; all of them, with
+// constant values in range, read an element of a const array right away.
+int64_t LValAST::const_eval(SymbolTable *stb, uint64_t context,
+                            const ArrayInfo &array) {
+  size_t n = index_l ? index_l->size() : 0;
+  if (n > array.dims.size())
+    throw flea_compiler_error("too many subscripts");
+  bool known = array.is_const;
+  int64_t index = 0;
+  for (size_t d = 0; d < n; ++d) {
+    int64_t val = fold_const((*index_l)[d], stb, context);
+    check_and_raise(val);
+    if (!check_const(val) || val < 0 || val >= array.dims[d])
+      known = false;
+    else
+      index += val * array.stride(d);
   }
+  if (known && n == array.dims.size())
+    return array.values[static_cast<size_t>(index)];
+  if (check_force(context))
+    throw not_const_error(*ident);
+  return n == array.dims.size() ? INT_VAR : ARR_VAR;
 }
 
 int64_t NumberAST::const_eval([[maybe_unused]] SymbolTable *stb,
@@ -365,16 +548,30 @@ int64_t NumberAST::const_eval([[maybe_unused]] SymbolTable *stb,
 int64_t CallExpAST::const_eval(SymbolTable *stb, uint64_t context) {
   if (!stb)
     return INT_VAR;
-  if (check_force(context))
-    throw flea_compiler_error("function call in const expression");
-  auto func_sign = stb->lookupFunc(*ident);
+  const Symbol &sym = stb->lookup(ident);
+  if (sym.kind == Symbol::NONE)
+    throw undeclared_error(*ident);
+  if (sym.kind != Symbol::FUNC)
+    throw not_func_error(*ident);
+  const FuncSign &func_sign = *sym.func;
   if (fparam_l->size() != func_sign.argTypes.size())
     throw flea_compiler_error("function call with wrong number of arguments");
+  std::vector<int32_t> args;
   for (size_t i = 0; i < fparam_l->size(); ++i) {
     int64_t val = fold_const((*fparam_l)[i], stb, context);
     if (get_type(val) != static_cast<uint64_t>(func_sign.argTypes[i]))
       throw flea_compiler_error("function call with wrong argument type");
+    if (check_const(val))
+      args.push_back(static_cast<int32_t>(val));
   }
+  // a pure function called with constant arguments is run right away
+  auto func_def = dynamic_cast<FuncDefAST *>(func_sign.def);
+  if (func_def && func_sign.returnType == static_cast<char>(INT) &&
+      args.size() == fparam_l->size())
+    if (auto result = Interp(stb).call(*func_def, args))
+      return *result;
+  if (check_force(context))
+    throw flea_compiler_error("function call in const expression");
   switch (func_sign.returnType) {
   case static_cast<char>(VOID):
     return VOID_VAR;
@@ -446,10 +643,6 @@ int64_t BinExpAST::const_eval(SymbolTable *stb, uint64_t context) {
 }
 
 bool LValAST::is_const(SymbolTable *stb) const {
-  try {
-    stb->lookupConst(*ident);
-    return true;
-  } catch (const flea_compiler_error &) {
-    return false;
-  }
+  const Symbol &sym = stb->lookup(ident);
+  return sym.kind == Symbol::CONST || (sym.array && sym.array->is_const);
 }
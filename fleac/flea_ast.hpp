@@ -4,29 +4,63 @@
 
 #define AST_INDENT 2
 
+#include "flea_arena.hpp"
+#include "flea_ir.hpp"
+#include "flea_lex.hpp"
+#include "flea_pool.hpp"
+#include "flea_report.hpp"
 #include "flea_sym.hpp"
+#include <deque>
 #include <iostream>
-#include <memory>
+#include <typeinfo>
 #include <vector>
 
+// Nodes live in the arena of their compilation unit and are never deleted
+// one by one, so most of them need no destructor.
 class BaseAST {
+protected:
+  ~BaseAST() = default;
+
 public:
-  virtual ~BaseAST() = default;
+  // the line the lexer was on when the node was built, that of its last
+  // token or of the one after it
+  int32_t line = yylineno;
   virtual void print(std::ostream &out) const = 0;
   virtual int64_t const_eval(SymbolTable *stb, uint64_t context = 0) = 0;
+  virtual Operand gen(IRGen &gen, SymbolTable *stb) = 0;
   friend std::ostream &operator<<(std::ostream &out, const BaseAST &ast);
 };
 
+using ASTList = ArenaList<BaseAST *>;
+
+// The arena that new nodes go to, that of the unit being built on this
+// thread.
+extern thread_local Arena *ast_arena;
+
+template <typename T, typename... Args> T *new_ast(Args &&...args) {
+  if (TimeReport::active)
+    TimeReport::active->count_node(typeid(T));
+  return ast_arena->make<T>(std::forward<Args>(args)...);
+}
+
+inline ASTList *new_ast_list() { return ast_arena->make<ASTList>(*ast_arena); }
+
 // CompUnit ::= FuncDef;
 class CompUnitAST : public BaseAST {
 public:
   // CompUnitAST(BaseAST *func_def) : func_def(func_def) {}
   // std::unique_ptr<BaseAST> func_def;
-  CompUnitAST() {}
+  CompUnitAST();
   SymbolTable stb;
-  std::vector<std::unique_ptr<BaseAST>> func_def_l, decl_l;
+  Arena arena;
+  std::vector<BaseAST *> func_def_l, decl_l;
+  // functions are checked and lowered on pool when set, each worker with
+  // its own copy of the global table and its own arena
+  ThreadPool *pool = nullptr;
+  std::deque<Arena> worker_arenas;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
   void insertDecl(BaseAST *decl);
   void insertFunc(BaseAST *func_def);
 };
@@ -35,35 +69,40 @@ public:
 // FuncDef ::= FuncType IDENT "(" ")" Block;
 class FuncDefAST : public BaseAST {
 public:
-  FuncDefAST(char type_id, std::string *ident, BaseAST *block,
-             std::vector<std::unique_ptr<BaseAST>> *fparam_l)
+  FuncDefAST(char type_id, Ident ident, BaseAST *block, ASTList *fparam_l)
       : func_type_id(type_id), ident(ident), block(block), fparam_l(fparam_l) {}
   char func_type_id;
-  std::unique_ptr<std::string> ident;
-  std::unique_ptr<BaseAST> block;
-  std::unique_ptr<std::vector<std::unique_ptr<BaseAST>>> fparam_l;
+  Ident ident;
+  BaseAST *block;
+  ASTList *fparam_l;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
-// FuncFParam ::= BType IDENT;
+// FuncFParam ::= BType IDENT ["[" "]" {"[" ConstExp "]"}];
 class FuncFParamAST : public BaseAST {
 public:
-  FuncFParamAST(char type_id, std::string *ident)
-      : type_id(type_id), ident(ident) {}
+  FuncFParamAST(char type_id, Ident ident, ASTList *dim_l = nullptr)
+      : type_id(type_id), ident(ident), dim_l(dim_l) {}
   char type_id;
-  std::unique_ptr<std::string> ident;
+  Ident ident;
+  ASTList *dim_l;
+  // of an array parameter, set by const_eval
+  ArrayInfo *array = nullptr;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 // Block ::= "{" {BlockItem} "}";
 class BlockAST : public BaseAST {
 public:
-  BlockAST(std::vector<std::unique_ptr<BaseAST>> *item_l) : item_l(item_l) {}
-  std::unique_ptr<std::vector<std::unique_ptr<BaseAST>>> item_l;
+  BlockAST(ASTList *item_l) : item_l(item_l) {}
+  ASTList *item_l;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 // BlockItem ::= Decl | Stmt;
@@ -81,39 +120,59 @@ public:
 // ConstDecl ::= "const" BType ConstDef {"," ConstDef} ";";
 class DeclAST : public BaseAST {
 public:
-  DeclAST(char type_id, std::vector<std::unique_ptr<BaseAST>> *def_l,
-          bool is_const = false)
+  DeclAST(char type_id, ASTList *def_l, bool is_const = false)
       : is_const(is_const), type_id(type_id), def_l(def_l) {}
   bool is_const;
   char type_id;
-  std::unique_ptr<std::vector<std::unique_ptr<BaseAST>>> def_l;
+  ASTList *def_l;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
+};
+
+class InitValAST;
+
+// An element of an array initializer and the element it initializes.
+struct InitElem {
+  int64_t index;
+  InitValAST *init;
 };
 
-// VarDef ::= IDENT "=" InitVal;
-// ConstDef ::= IDENT "=" ConstInitVal;
+// VarDef ::= IDENT {"[" ConstExp "]"} ["=" InitVal];
+// ConstDef ::= IDENT {"[" ConstExp "]"} "=" ConstInitVal;
 class DefAST : public BaseAST {
 public:
-  DefAST(std::string *ident, BaseAST *init_val = nullptr, bool is_const = false)
-      : is_const(is_const), ident(ident), init_val(init_val) {}
+  DefAST(Ident ident, BaseAST *init_val = nullptr, bool is_const = false,
+         ASTList *dim_l = nullptr)
+      : is_const(is_const), ident(ident), init_val(init_val), dim_l(dim_l) {}
   bool is_const;
-  std::unique_ptr<std::string> ident;
-  std::unique_ptr<BaseAST> init_val;
+  Ident ident;
+  BaseAST *init_val;
+  ASTList *dim_l;
+  // of an array, set by const_eval: its shape and its initializer laid out
+  // row-major
+  ArrayInfo *array = nullptr;
+  ArenaList<InitElem> *elems = nullptr;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
-// InitVal ::= Exp;
-// ConstInitVal ::= ConstExp;
+// InitVal ::= Exp | "{" [InitVal {"," InitVal}] "}";
+// ConstInitVal ::= ConstExp | "{" [ConstInitVal {"," ConstInitVal}] "}";
 class InitValAST : public BaseAST {
 public:
   InitValAST(BaseAST *exp, bool is_const = false)
       : is_const(is_const), exp(exp) {}
+  InitValAST(ASTList *init_l, bool is_const = false)
+      : is_const(is_const), init_l(init_l) {}
   bool is_const;
-  std::unique_ptr<BaseAST> exp;
+  BaseAST *exp = nullptr;
+  // the braced list, if this is one
+  ASTList *init_l = nullptr;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 // class StmtAST : public BaseAST {
@@ -128,18 +187,20 @@ public:
 class ExpStmtAST : public BaseAST {
 public:
   ExpStmtAST(BaseAST *exp) : exp(exp) {}
-  std::unique_ptr<BaseAST> exp;
+  BaseAST *exp;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 // RetStmt ::= "return" Exp ";";
 class RetStmtAST : public BaseAST {
 public:
   RetStmtAST(BaseAST *exp) : exp(exp) {}
-  std::unique_ptr<BaseAST> exp;
+  BaseAST *exp;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 class BreakStmtAST : public BaseAST {
@@ -147,6 +208,7 @@ public:
   BreakStmtAST() {}
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 class ContinueStmtAST : public BaseAST {
@@ -154,16 +216,18 @@ public:
   ContinueStmtAST() {}
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 // AssignStmt ::= LVal "=" Exp ";";
 class AssignStmtAST : public BaseAST {
 public:
   AssignStmtAST(BaseAST *lval, BaseAST *exp) : lval(lval), exp(exp) {}
-  std::unique_ptr<BaseAST> lval;
-  std::unique_ptr<BaseAST> exp;
+  BaseAST *lval;
+  BaseAST *exp;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 class IfStmtAST : public BaseAST {
@@ -171,21 +235,23 @@ public:
   IfStmtAST(BaseAST *cond, BaseAST *then_stmt = nullptr,
             BaseAST *else_stmt = nullptr)
       : cond(cond), then_stmt(then_stmt), else_stmt(else_stmt) {}
-  std::unique_ptr<BaseAST> cond;
-  std::unique_ptr<BaseAST> then_stmt;
-  std::unique_ptr<BaseAST> else_stmt;
+  BaseAST *cond;
+  BaseAST *then_stmt;
+  BaseAST *else_stmt;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 class WhileStmtAST : public BaseAST {
 public:
   WhileStmtAST(BaseAST *cond, BaseAST *stmt = nullptr)
       : cond(cond), stmt(stmt) {}
-  std::unique_ptr<BaseAST> cond;
-  std::unique_ptr<BaseAST> stmt;
+  BaseAST *cond;
+  BaseAST *stmt;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 // Exp ::= EqExp;
@@ -194,27 +260,34 @@ class ExpAST : public BaseAST {
 public:
   ExpAST(BaseAST *exp, bool is_const = false) : is_const(is_const), exp(exp) {}
   bool is_const;
-  std::unique_ptr<BaseAST> exp;
+  BaseAST *exp;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 // PrimaryExp ::= "(" Exp ")" | LVal | Number;
 class PrimaryExpAST : public BaseAST {
 public:
   PrimaryExpAST(BaseAST *exp) : exp(exp) {}
-  std::unique_ptr<BaseAST> exp;
+  BaseAST *exp;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
-// LVal ::= IDENT;
+// LVal ::= IDENT {"[" Exp "]"};
 class LValAST : public BaseAST {
 public:
-  LValAST(std::string *ident) : ident(ident) {}
-  std::unique_ptr<std::string> ident;
+  LValAST(Ident ident, ASTList *index_l = nullptr)
+      : ident(ident), index_l(index_l) {}
+  Ident ident;
+  ASTList *index_l;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  int64_t const_eval(SymbolTable *stb, uint64_t context,
+                     const ArrayInfo &array);
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
   bool is_const(SymbolTable *stb) const;
 };
 
@@ -225,18 +298,19 @@ public:
   int32_t number;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 // CallExp ::= IDENT "(" [FuncRParams] ")";
 class CallExpAST : public BaseAST {
 public:
-  CallExpAST(std::string *ident,
-             std::vector<std::unique_ptr<BaseAST>> *fparam_l)
+  CallExpAST(Ident ident, ASTList *fparam_l)
       : ident(ident), fparam_l(fparam_l) {}
-  std::unique_ptr<std::string> ident;
-  std::unique_ptr<std::vector<std::unique_ptr<BaseAST>>> fparam_l;
+  Ident ident;
+  ASTList *fparam_l;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 // UnaryOp ::= "+" | "-" | "!";
@@ -245,9 +319,10 @@ class UnaryExpAST : public BaseAST {
 public:
   UnaryExpAST(char unary_op, BaseAST *exp) : unary_op(unary_op), exp(exp) {}
   char unary_op;
-  std::unique_ptr<BaseAST> exp;
+  BaseAST *exp;
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
 };
 
 class BinExpAST : public BaseAST {
@@ -256,12 +331,14 @@ protected:
 
 public:
   char op;
-  std::unique_ptr<BaseAST> lhs;
-  std::unique_ptr<BaseAST> rhs;
+  BaseAST *lhs;
+  BaseAST *rhs;
 
   BinExpAST(char op, BaseAST *lhs, BaseAST *rhs) : op(op), lhs(lhs), rhs(rhs) {}
   void print(std::ostream &out) const override final;
   int64_t const_eval(SymbolTable *stb, uint64_t context = 0) override final;
+  Operand gen(IRGen &gen, SymbolTable *stb) override final;
+  Operand gen_op(IRGen &gen, SymbolTable *stb, char op);
 };
 
 // MulExp ::= UnaryExp | (MulExp ("*" | "/" | "%") UnaryExp);
@@ -0,0 +1,182 @@
+#include "flea_cache.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+// bumped whenever the key or the emitted code changes shape
+static constexpr uint64_t cache_version = 5;
+
+namespace {
+struct Hasher {
+  uint64_t h = 0xcbf29ce484222325;
+  void add(uint64_t v) {
+    for (int i = 0; i < 8; ++i, v >>= 8)
+      h = (h ^ (v & 0xff)) * 0x100000001b3;
+  }
+  void add(const std::string &s) {
+    add(s.size());
+    for (char c : s)
+      h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+  }
+  void add(const Operand &op) {
+    add(static_cast<uint64_t>(op.kind));
+    add(static_cast<uint64_t>(static_cast<uint32_t>(op.val)));
+  }
+};
+} // namespace
+
+// Reads back an operand as FleaOpd writes it.
+static bool parse(const std::string &s, FleaOpd &o) {
+  if (s.size() < 2)
+    return false;
+  if (s[0] == '[') {
+    size_t p = s.find('+');
+    FleaOpd base, idx;
+    if (p == std::string::npos || s.back() != ']' ||
+        !parse(s.substr(1, p - 1), base) ||
+        !parse(s.substr(p + 1, s.size() - p - 2), idx))
+      return false;
+    return o = FleaOpd(base, idx), true;
+  }
+  const char *digits = s.c_str() + (s[0] == '%' ? 2 : 1);
+  char *end;
+  long val = strtol(digits, &end, 10);
+  if (end == digits || *end || !strchr("@$#%", s[0]))
+    return false;
+  return o = FleaOpd(s[0], static_cast<int32_t>(val)), true;
+}
+
+FuncCache::FuncCache(std::string dir, int opt_level, int32_t inline_threshold)
+    : dir(std::move(dir)), opt_level(opt_level),
+      inline_threshold(inline_threshold) {}
+
+std::string FuncCache::path(uint64_t key) const {
+  char name[17];
+  snprintf(name, sizeof name, "%016llx", static_cast<unsigned long long>(key));
+  return dir + "/" + name;
+}
+
+uint64_t FuncCache::key(const Module &mod, int32_t func_id) const {
+  const Function &func = mod.funcs[func_id];
+  Hasher h;
+  h.add(cache_version);
+  h.add(static_cast<uint64_t>(opt_level));
+  h.add(static_cast<uint64_t>(static_cast<uint32_t>(inline_threshold)));
+  h.add(func_id == mod.main_id);
+  h.add(func.name);
+  h.add(func.ret_int);
+  h.add(static_cast<uint64_t>(func.nparams));
+  h.add(static_cast<uint64_t>(func.ntemps));
+  h.add(static_cast<uint64_t>(func.frame_size));
+  h.add(func.blocks.size());
+  for (const auto &block : func.blocks) {
+    h.add(static_cast<uint64_t>(block.term));
+    h.add(block.cond);
+    h.add(static_cast<uint64_t>(static_cast<uint32_t>(block.succ[0])));
+    h.add(static_cast<uint64_t>(static_cast<uint32_t>(block.succ[1])));
+    h.add(
+        static_cast<uint64_t>(static_cast<uint32_t>(block.line - func.line)));
+    h.add(block.insts.size());
+    for (const auto &inst : block.insts) {
+      h.add(static_cast<uint64_t>(inst.op));
+      h.add(static_cast<uint64_t>(inst.sub));
+      h.add(inst.dst), h.add(inst.a), h.add(inst.b);
+      h.add(
+          static_cast<uint64_t>(static_cast<uint32_t>(inst.line - func.line)));
+      h.add(inst.args.size());
+      for (const auto &arg : inst.args)
+        h.add(arg);
+      h.add(inst.from.size());
+      for (int32_t from : inst.from)
+        h.add(static_cast<uint64_t>(static_cast<uint32_t>(from)));
+      if (inst.op == Op::CALL) {
+        const Function &callee = mod.funcs[inst.func];
+        h.add(callee.name);
+        h.add(callee.ret_int);
+        h.add(static_cast<uint64_t>(callee.nparams));
+        h.add(inst.func == mod.main_id);
+      }
+    }
+  }
+  return h.h;
+}
+
+// An entry is the function name followed by one line per instruction:
+// the reference kind ('-' for none), its target (a line number, or the
+// callee name for 'f'), its source line and the instruction as text.
+// Source lines are kept relative to the end of the function, so that
+// moving the function does not change its key.
+bool FuncCache::load(uint64_t key, const Module &mod, int32_t func_id,
+                     FleaFunc &code) const {
+  std::ifstream in(path(key));
+  std::string name, line;
+  if (!in || !std::getline(in, name) || name != mod.funcs[func_id].name)
+    return false;
+  FleaFunc result{name, {}};
+  int32_t base = mod.funcs[func_id].line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    char ref;
+    std::string target;
+    FleaCode c;
+    if (!(fields >> ref >> target >> c.line))
+      return false;
+    c.line += base;
+    std::string opd;
+    if (!(fields >> c.op))
+      return false;
+    for (FleaOpd *o : {&c.a, &c.b, &c.c})
+      if (fields >> opd && !parse(opd, *o))
+        return false;
+    if (ref == 'f') {
+      c.ref_id = -1;
+      for (int32_t f = 0; f < static_cast<int32_t>(mod.funcs.size()); ++f)
+        if (mod.funcs[f].name == target)
+          c.ref_id = f;
+      if (c.ref_id == -1)
+        return false;
+    } else if (ref == 'l')
+      c.ref_id = static_cast<int32_t>(strtol(target.c_str(), nullptr, 10));
+    c.ref = ref == '-' ? 0 : ref;
+    result.code.push_back(std::move(c));
+  }
+  code = std::move(result);
+  return true;
+}
+
+void FuncCache::store(uint64_t key, const Module &mod, int32_t func_id,
+                      const FleaFunc &code) const {
+  int32_t base = mod.funcs[func_id].line;
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  // functions with the same key may be stored at once from several threads
+  std::string file = path(key),
+              tmp = file + "." +
+                    std::to_string(std::hash<std::thread::id>()(
+                        std::this_thread::get_id())) +
+                    ".tmp";
+  {
+    std::ofstream out(tmp);
+    if (!out)
+      return;
+    out << code.name << "\n";
+    for (const auto &c : code.code) {
+      out << (c.ref ? c.ref : '-') << " ";
+      if (c.ref == 'f')
+        out << mod.funcs[c.ref_id].name;
+      else
+        out << c.ref_id;
+      out << " " << c.line - base << " " << c << "\n";
+    }
+    if (!out)
+      return;
+  }
+  // renamed into place so that a reader never sees half an entry
+  std::filesystem::rename(tmp, file, ec);
+  if (ec)
+    std::filesystem::remove(tmp, ec);
+}
@@ -0,0 +1,31 @@
+#ifndef FLEA_CACHE_HPP_FLAG
+#define FLEA_CACHE_HPP_FLAG
+
+#include "flea_emit.hpp"
+#include "flea_ir.hpp"
+#include <cstdint>
+#include <string>
+
+// On-disk cache of the emitted code of functions. A function is keyed by a
+// hash of its IR once the passes across functions have run, so the key
+// covers what inlining took in from its callees, the addresses of the
+// globals it uses and the signatures of what it still calls. Calls are
+// stored by callee name, which survives the renumbering of functions.
+// Failing to read or write the cache only costs the recompilation.
+class FuncCache {
+public:
+  FuncCache(std::string dir, int opt_level, int32_t inline_threshold);
+  uint64_t key(const Module &mod, int32_t func_id) const;
+  bool load(uint64_t key, const Module &mod, int32_t func_id,
+            FleaFunc &code) const;
+  void store(uint64_t key, const Module &mod, int32_t func_id,
+             const FleaFunc &code) const;
+
+private:
+  std::string dir;
+  int opt_level;
+  int32_t inline_threshold;
+  std::string path(uint64_t key) const;
+};
+
+#endif // FLEA_CACHE_HPP_FLAG
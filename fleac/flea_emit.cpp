@@ -0,0 +1,384 @@
+#include "flea_emit.hpp"
+#include "flea_alloc.hpp"
+#include "flea_expr.hpp"
+#include <algorithm>
+#include <cassert>
+
+// Calling convention: %r0 is the frame pointer, %r1 holds the return
+// address on entry and %r2 the return value on exit. Parameter i lives at
+// [%r0+@-1-i]; a function that makes calls saves %r1 at [%r0+@0], and
+// the slots after it hold temporaries and then the local arrays. Calls
+// clobber the registers from %r3 on, which hold temporaries that do not
+// live across one. The caller places the arguments right after its own
+// frame and moves %r0 past them; a tail call instead overwrites its own
+// parameters and jumps with the caller's return address, so the callee
+// returns for it. A failed bounds check exits with status trap_status.
+
+constexpr int32_t trap_status = 134;
+
+static FleaOpd imm(int32_t val) { return {'@', val}; }
+
+static FleaOpd reg(int32_t r) { return {'%', r}; }
+
+static FleaOpd slot(int32_t offset) { return {reg(0), imm(offset)}; }
+
+std::ostream &operator<<(std::ostream &os, const FleaOpd &o) {
+  switch (o.type) {
+  case '%':
+    return os << "%r" << o.val;
+  case '[':
+    return os << "[" << FleaOpd(o.base_type, o.val) << "+"
+              << FleaOpd(o.idx_type, o.idx) << "]";
+  default:
+    return os << o.type << o.val;
+  }
+}
+
+std::ostream &operator<<(std::ostream &os, const FleaCode &c) {
+  os << c.op;
+  for (const FleaOpd *o : {&c.a, &c.b, &c.c})
+    if (o->type)
+      os << " " << *o;
+  return os;
+}
+
+class FuncEmitter {
+public:
+  const Module &mod;
+  const Function &func;
+  bool is_main, has_call = false;
+  // the frame size and the slot the local arrays start at
+  int32_t frame = 0, arrays = 0;
+  // the source line of the code being emitted
+  int32_t src_line = 0;
+  std::vector<Home> homes;
+  std::vector<int32_t> block_line;
+  FleaFunc out;
+
+  FuncEmitter(const Module &mod, int32_t func_id)
+      : mod(mod), func(mod.funcs[func_id]),
+        is_main(func_id == mod.main_id) {
+    for (const auto &block : func.blocks)
+      for (const auto &inst : block.insts)
+        has_call |= inst.op == Op::CALL;
+    homes = allocate(func, has_call && !is_main ? 1 : 0, frame);
+    arrays = frame;
+    frame += func.frame_size;
+  }
+
+  FleaOpd opd(const Operand &opd) const {
+    switch (opd.kind) {
+    case Operand::IMM:
+      return imm(opd.val);
+    case Operand::MEM:
+      return {'$', opd.val};
+    case Operand::TEMP:
+      if (homes[opd.val].reg != -1)
+        return reg(homes[opd.val].reg);
+      return slot(homes[opd.val].slot);
+    default:
+      assert(false);
+      __builtin_unreachable();
+    }
+  }
+
+  // The cell at address a + b as one operand where the addressing modes
+  // allow: [base+idx] adds an immediate, a global or a register to a
+  // register or a global. Otherwise the address goes through %r2.
+  FleaOpd cell(const Operand &a, const Operand &b) {
+    if (a.is_imm() && b.is_imm())
+      return {'$', safe_add(a.val, b.val)};
+    FleaOpd x = opd(a), y = opd(b);
+    if (x.type == '$' && y == imm(0))
+      return {'#', x.val};
+    if (y.type == '$' && x == imm(0))
+      return {'#', y.val};
+    auto base = [](const FleaOpd &o) { return o.type == '%' || o.type == '$'; };
+    if (base(x) && y.type != '[')
+      return {x, y};
+    if (base(y) && x.type != '[')
+      return {y, x};
+    code("+", x, y, reg(2));
+    return {reg(2), imm(0)};
+  }
+
+  void code(std::string op, FleaOpd a, FleaOpd b = {}, FleaOpd c = {}) {
+    out.code.push_back({std::move(op), a, b, c, 0, 0, src_line});
+  }
+
+  // An instruction whose operand b is the jump target ref_id.
+  void code(std::string op, FleaOpd a, char ref, int32_t ref_id) {
+    out.code.push_back({std::move(op), a, {}, {}, ref, ref_id, src_line});
+  }
+
+  int32_t line() const { return static_cast<int32_t>(out.code.size()); }
+
+  void inst(const Inst &inst) {
+    if (inst.line)
+      src_line = inst.line;
+    switch (inst.op) {
+    case Op::MOV:
+      if (opd(inst.dst) != opd(inst.a))
+        code("=", opd(inst.dst), opd(inst.a));
+      break;
+    case Op::BIN:
+      code(id2op(inst.sub), opd(inst.a), opd(inst.b), opd(inst.dst));
+      break;
+    case Op::UN:
+      code(inst.sub == '-' ? "neg" : "!", opd(inst.a), opd(inst.dst));
+      break;
+    case Op::PHI:
+      assert(false); // removed by from_ssa
+      break;
+    case Op::FRAME:
+      code("+", reg(0), imm(arrays + inst.a.val), opd(inst.dst));
+      break;
+    case Op::LOAD: {
+      FleaOpd src = cell(inst.a, inst.b);
+      code("=", opd(inst.dst), src);
+      break;
+    }
+    case Op::STORE: {
+      FleaOpd dst = cell(inst.a, inst.b);
+      code("=", dst, opd(inst.args[0]));
+      break;
+    }
+    case Op::CHECK:
+      check(inst.a, inst.b);
+      break;
+    case Op::CALL:
+      inst.tail ? tail_call(inst) : call(inst);
+      break;
+    case Op::GETI:
+      code("geti", opd(inst.dst));
+      break;
+    case Op::GETC:
+      code("getc", opd(inst.dst));
+      break;
+    case Op::PUTI:
+      code("puti", opd(inst.a));
+      break;
+    case Op::PUTC:
+      code("putc", opd(inst.a));
+      break;
+    }
+  }
+
+  void call(const Inst &inst) {
+    auto n = static_cast<int32_t>(inst.args.size());
+    int32_t shift = frame + n;
+    for (int32_t i = 0; i < n; ++i)
+      code("=", slot(shift - 1 - i), opd(inst.args[i]));
+    code("=", reg(1), 'l', line() + (shift ? 3 : 2));
+    if (shift)
+      code("+", reg(0), imm(shift), reg(0));
+    code("if", imm(1), 'f', inst.func);
+    if (shift)
+      code("-", reg(0), imm(shift), reg(0));
+    if (inst.dst.kind != Operand::NONE)
+      code("=", opd(inst.dst), reg(2));
+  }
+
+  void check(const Operand &index, const Operand &size) {
+    FleaOpd trap = imm(-1 - trap_status);
+    code("<", opd(index), imm(0), reg(2));
+    code("if", reg(2), trap);
+    code(id2op('g'), opd(index), opd(size), reg(2));
+    code("if", reg(2), trap);
+  }
+
+  // The arguments are a parallel copy into the parameter slots, which may
+  // be read by other arguments; %r2 breaks cycles.
+  void tail_call(const Inst &inst) {
+    std::vector<std::pair<FleaOpd, FleaOpd>> moves;
+    for (size_t i = 0; i < inst.args.size(); ++i) {
+      FleaOpd to = slot(-1 - static_cast<int32_t>(i));
+      FleaOpd from = opd(inst.args[i]);
+      if (to != from)
+        moves.emplace_back(to, from);
+    }
+    while (!moves.empty()) {
+      auto ready = std::find_if(moves.begin(), moves.end(), [&](auto &m) {
+        return std::none_of(moves.begin(), moves.end(),
+                            [&](auto &n) { return n.second == m.first; });
+      });
+      if (ready == moves.end()) {
+        FleaOpd blocked = moves.front().first;
+        code("=", reg(2), blocked);
+        for (auto &m : moves)
+          if (m.second == blocked)
+            m.second = reg(2);
+        continue;
+      }
+      code("=", ready->first, ready->second);
+      moves.erase(ready);
+    }
+    code("=", reg(1), slot(0));
+    code("if", imm(1), 'f', inst.func);
+  }
+
+  void jump(int32_t target, int32_t next) {
+    if (target != next)
+      code("if", imm(1), 'b', target);
+  }
+
+  // main exits by jumping to -1 - status, so the status is taken modulo
+  // 256 as a POSIX exit would, or a negative one would jump into the code.
+  void ret(const Operand &val) {
+    if (is_main) {
+      if (val.kind == Operand::NONE)
+        return code("if", imm(1), imm(-1));
+      if (val.is_imm())
+        return code("if", imm(1), imm(-1 - (val.val & 255)));
+      code("&", opd(val), imm(255), reg(2));
+      code("-", imm(-1), reg(2), reg(2));
+      return code("if", imm(1), reg(2));
+    }
+    if (val.kind != Operand::NONE)
+      code("=", reg(2), opd(val));
+    code("if", imm(1), has_call ? slot(0) : reg(1));
+  }
+
+  // Code made by the passes has no line and goes with the code before it;
+  // the prologue goes with the first line known.
+  FleaFunc emit() {
+    out.name = func.name;
+    src_line = func.line;
+    for (auto block = func.blocks.rbegin(); block != func.blocks.rend();
+         ++block) {
+      if (block->line)
+        src_line = block->line;
+      for (auto inst = block->insts.rbegin(); inst != block->insts.rend();
+           ++inst)
+        if (inst->line)
+          src_line = inst->line;
+    }
+    if (has_call && !is_main)
+      code("=", slot(0), reg(1));
+    auto count = static_cast<int32_t>(func.blocks.size());
+    block_line.assign(count, 0);
+    for (int32_t i = 0; i < count; ++i) {
+      const Block &block = func.blocks[i];
+      block_line[i] = line();
+      for (const auto &inst : block.insts)
+        this->inst(inst);
+      if (block.line)
+        src_line = block.line;
+      switch (block.term) {
+      case Block::JMP:
+        jump(block.succ[0], i + 1);
+        break;
+      case Block::BR:
+        code("if", opd(block.cond), 'b', block.succ[0]);
+        jump(block.succ[1], i + 1);
+        break;
+      case Block::RET:
+        if (block.insts.empty() || !block.insts.back().tail)
+          ret(block.cond);
+        break;
+      }
+    }
+    for (auto &c : out.code)
+      if (c.ref == 'b')
+        c.ref = 'l', c.ref_id = block_line[c.ref_id];
+    return std::move(out);
+  }
+};
+
+FleaFunc emit_func(const Module &mod, int32_t func_id) {
+  return FuncEmitter(mod, func_id).emit();
+}
+
+void emit_module(const Module &mod, std::ostream &out) {
+  std::vector<FleaFunc> funcs;
+  for (int32_t i = 0; i < static_cast<int32_t>(mod.funcs.size()); ++i)
+    funcs.push_back(emit_func(mod, i));
+  link_module(mod, funcs, out);
+}
+
+// The order of the functions in the linked code and the line each starts
+// at; the end is one past the last line.
+struct Placement {
+  std::vector<int32_t> order, start;
+  int32_t end = 2;
+};
+
+static Placement place(const Module &mod,
+                       const std::vector<FleaFunc> &funcs) {
+  Placement l;
+  l.order = {mod.main_id};
+  for (int32_t i = 0; i < static_cast<int32_t>(mod.funcs.size()); ++i)
+    if (i != mod.main_id)
+      l.order.push_back(i);
+  l.start.resize(mod.funcs.size());
+  for (int32_t i : l.order) {
+    l.start[i] = l.end;
+    l.end += static_cast<int32_t>(funcs[i].code.size());
+  }
+  return l;
+}
+
+std::vector<FleaCode> link_code(const Module &mod,
+                                const std::vector<FleaFunc> &funcs) {
+  Placement l = place(mod, funcs);
+  std::vector<FleaCode> code;
+  code.reserve(static_cast<size_t>(l.end - 1));
+  code.push_back(
+      {"=", reg(0), imm(static_cast<int32_t>(mod.data.size())), {}});
+  for (int32_t i : l.order)
+    for (FleaCode c : funcs[i].code) {
+      if (c.ref == 'l')
+        c.b = imm(l.start[i] + c.ref_id);
+      else if (c.ref == 'f')
+        c.b = imm(l.start[c.ref_id]);
+      c.ref = 0;
+      code.push_back(std::move(c));
+    }
+  return code;
+}
+
+void link_module(const Module &mod, const std::vector<FleaFunc> &funcs,
+                 std::ostream &out) {
+  for (size_t i = 0; i < mod.data.size();) {
+    if (!mod.data[i]) {
+      ++i;
+      continue;
+    }
+    size_t j = i;
+    while (j < mod.data.size() && mod.data[j])
+      ++j;
+    out << ".data " << i << " " << j - i;
+    for (; i < j; ++i)
+      out << " " << mod.data[i];
+    out << "\n";
+  }
+  for (const auto &c : link_code(mod, funcs))
+    out << c << "\n";
+}
+
+LineTable link_lines(const Module &mod, const std::vector<FleaFunc> &funcs,
+                     std::string file) {
+  Placement l = place(mod, funcs);
+  LineTable table{std::move(file), {}, {{1, 0, -1}}};
+  for (const auto &func : mod.funcs)
+    table.funcs.push_back(func.name);
+  for (int32_t i : l.order) {
+    int32_t line = l.start[i];
+    for (const auto &c : funcs[i].code) {
+      const LineTable::Row &last = table.rows.back();
+      if (last.src_line != c.line || last.func != i)
+        table.rows.push_back({line, c.line, i});
+      ++line;
+    }
+  }
+  return table;
+}
+
+std::ostream &operator<<(std::ostream &out, const LineTable &table) {
+  out << "file " << table.file << "\n";
+  for (const auto &name : table.funcs)
+    out << "func " << name << "\n";
+  for (const auto &row : table.rows)
+    out << row.line << " " << row.src_line << " " << row.func << "\n";
+  return out;
+}
@@ -0,0 +1,71 @@
+#ifndef FLEA_EMIT_HPP_FLAG
+#define FLEA_EMIT_HPP_FLAG
+
+#include "flea_ir.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+// One operand as the VM reads it: '@' an immediate, '$' a global, '#' the
+// cell a global points to, '%' a register, or '[' the cell [base+idx],
+// whose base is a '$' or '%' operand and index an '@', '$' or '%' one.
+// A type of 0 is no operand.
+struct FleaOpd {
+  char type = 0, base_type = 0, idx_type = 0;
+  int32_t val = 0, idx = 0;
+  FleaOpd() = default;
+  FleaOpd(char type, int32_t val) : type(type), val(val) {}
+  FleaOpd(const FleaOpd &base, const FleaOpd &idx)
+      : type('['), base_type(base.type), idx_type(idx.type), val(base.val),
+        idx(idx.val) {}
+  bool operator==(const FleaOpd &) const = default;
+  friend std::ostream &operator<<(std::ostream &os, const FleaOpd &o);
+};
+
+// One flea instruction and the source line it was made from. If ref is
+// set, b is a jump target resolved by linking: 'l' is a line of the same
+// function, 'f' a function entry.
+struct FleaCode {
+  std::string op;
+  FleaOpd a, b, c;
+  char ref = 0;
+  int32_t ref_id = 0, line = 0;
+  friend std::ostream &operator<<(std::ostream &os, const FleaCode &c);
+};
+
+// Relocatable code of one function; lines are linked by link_code.
+struct FleaFunc {
+  std::string name;
+  std::vector<FleaCode> code;
+};
+
+FleaFunc emit_func(const Module &mod, int32_t func_id);
+void emit_module(const Module &mod, std::ostream &out);
+
+// The code of the functions of mod, laid out with main first after the
+// line that sets up the frame pointer, with the jump targets resolved.
+std::vector<FleaCode> link_code(const Module &mod,
+                                const std::vector<FleaFunc> &funcs);
+
+// Writes the data and the linked code of mod as text.
+void link_module(const Module &mod, const std::vector<FleaFunc> &funcs,
+                 std::ostream &out);
+
+// Where the linked code came from. Each row covers the lines from its own
+// up to the next row's, made from src_line of the function numbered func,
+// or of none if func is -1. Written as text, the file comes first, then
+// the function names and then one row per line.
+struct LineTable {
+  struct Row {
+    int32_t line, src_line, func;
+  };
+  std::string file;
+  std::vector<std::string> funcs;
+  std::vector<Row> rows;
+  friend std::ostream &operator<<(std::ostream &out, const LineTable &table);
+};
+
+LineTable link_lines(const Module &mod, const std::vector<FleaFunc> &funcs,
+                     std::string file);
+
+#endif // FLEA_EMIT_HPP_FLAG
@@ -49,4 +49,6 @@ int32_t floor_div(int32_t a, int32_t b) {
   return r.quot - (r.rem < 0 ? 1 : 0);
 }
 
-int32_t floor_mod(int32_t a, int32_t b) { return a - floor_div(a, b) * b; }
+int32_t floor_mod(int32_t a, int32_t b) {
+  return safe_sub(a, safe_mul(floor_div(a, b), b));
+}
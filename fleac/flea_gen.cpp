@@ -0,0 +1,479 @@
+#include "flea_ast.hpp"
+#include "flea_expr.hpp"
+#include "flea_ir.hpp"
+#include <algorithm>
+#include <cassert>
+
+// gen functions: lower the checked AST into IR
+
+static char negate_op(char op) {
+  switch (op) {
+  case '<':
+    return 'g';
+  case 'g':
+    return '<';
+  case '>':
+    return 'l';
+  case 'l':
+    return '>';
+  case 'e':
+    return 'n';
+  case 'n':
+    return 'e';
+  default:
+    return 0;
+  }
+}
+
+// Lowers a condition, negated if asked; comparisons are inverted in place.
+static Operand gen_cond(BaseAST *ast, IRGen &gen, SymbolTable *stb,
+                        bool negate) {
+  if (auto exp = dynamic_cast<ExpAST *>(ast))
+    return gen_cond(exp->exp, gen, stb, negate);
+  if (auto exp = dynamic_cast<PrimaryExpAST *>(ast))
+    return gen_cond(exp->exp, gen, stb, negate);
+  if (auto exp = dynamic_cast<UnaryExpAST *>(ast)) {
+    if (exp->unary_op == 0 || exp->unary_op == '+')
+      return gen_cond(exp->exp, gen, stb, negate);
+    if (exp->unary_op == '!')
+      return gen_cond(exp->exp, gen, stb, !negate);
+  }
+  if (auto exp = dynamic_cast<BinExpAST *>(ast)) {
+    if (!exp->rhs)
+      return gen_cond(exp->lhs, gen, stb, negate);
+    if (negate && negate_op(exp->op))
+      return exp->gen_op(gen, stb, negate_op(exp->op));
+  }
+  Operand val = ast->gen(gen, stb);
+  if (!negate)
+    return val;
+  if (val.is_imm())
+    return Operand::imm(!val.val);
+  Operand dst = gen.new_temp();
+  gen.emit(Inst(Op::UN, dst, val, {}, '!'));
+  return dst;
+}
+
+// Adds or multiplies for an address, folding constants.
+static Operand gen_bin(IRGen &gen, char op, Operand a, Operand b) {
+  if (a.is_imm() && b.is_imm())
+    return Operand::imm(op == '+' ? safe_add(a.val, b.val)
+                                  : safe_mul(a.val, b.val));
+  if (op == '+' && a == Operand::imm(0))
+    return b;
+  if (op == '+' && b == Operand::imm(0))
+    return a;
+  Operand dst = gen.new_temp();
+  gen.emit(Inst(Op::BIN, dst, a, b, op));
+  return dst;
+}
+
+// Lowers the subscripts of an access to array into the offset of what they
+// select, a sum of subscripts times strides for the loop optimizations to
+// hoist and strength-reduce. With bounds checking, each subscript not known
+// to be in range is checked against its dimension, except the first one of
+// a parameter, which is not known.
+static Operand gen_offset(LValAST *lval, IRGen &gen, SymbolTable *stb,
+                          const ArrayInfo &array) {
+  Operand offset = Operand::imm(0);
+  if (!lval->index_l)
+    return offset;
+  for (size_t d = 0; d < lval->index_l->size(); ++d) {
+    Operand index = (*lval->index_l)[d]->gen(gen, stb);
+    int32_t dim = array.dims[d];
+    if (gen.bounds_check && dim &&
+        !(index.is_imm() && index.val >= 0 && index.val < dim))
+      gen.emit(Inst(Op::CHECK, {}, index, Operand::imm(dim)));
+    auto stride = static_cast<int32_t>(array.stride(d));
+    if (stride != 1)
+      index = gen_bin(gen, '*', index, Operand::imm(stride));
+    offset = gen_bin(gen, '+', offset, index);
+  }
+  return offset;
+}
+
+Operand CompUnitAST::gen(IRGen &gen, [[maybe_unused]] SymbolTable *stb) {
+  gen.globals = &this->stb;
+  gen.global_count = this->stb.getOffset();
+  gen.mod.data.assign(static_cast<size_t>(gen.global_count), 0);
+  auto init = [&](int64_t addr, BaseAST *exp) {
+    if (auto num = dynamic_cast<NumberAST *>(exp))
+      gen.mod.data[addr] = num->number;
+    else
+      gen.global_inits.emplace_back(static_cast<int32_t>(addr), exp);
+  };
+  for (const auto &decl : decl_l) {
+    auto decl_ast = dynamic_cast<DeclAST *>(decl);
+    assert(decl_ast);
+    for (const auto &def : *decl_ast->def_l) {
+      auto def_ast = dynamic_cast<DefAST *>(def);
+      assert(def_ast);
+      if (decl_ast->is_const && !def_ast->array)
+        continue;
+      int64_t addr = this->stb.lookupGlobal(def_ast->ident).offset;
+      if (def_ast->array && def_ast->is_const)
+        std::copy(def_ast->array->values.begin(),
+                  def_ast->array->values.end(), gen.mod.data.begin() + addr);
+      else if (def_ast->elems)
+        for (const auto &elem : *def_ast->elems)
+          init(addr + elem.index, elem.init->exp);
+      else if (def_ast->init_val)
+        init(addr, def_ast->init_val);
+    }
+  }
+  for (const auto &func_def : func_def_l) {
+    auto func_def_ast = dynamic_cast<FuncDefAST *>(func_def);
+    gen.func_ids[*func_def_ast->ident] =
+        static_cast<int32_t>(gen.func_ids.size());
+  }
+  if (!gen.func_ids.count("main"))
+    throw flea_compiler_error("undefined reference to 'main'");
+  gen.mod.main_id = gen.func_ids["main"];
+  gen.mod.funcs.resize(func_def_l.size());
+  if (!pool) {
+    for (const auto &func_def : func_def_l) {
+      this->stb.push();
+      func_def->gen(gen, &this->stb);
+      this->stb.pop();
+    }
+    return {};
+  }
+  // each function fills in its own slot of mod.funcs
+  std::vector<SymbolTable> stbs(pool->size(), this->stb);
+  std::vector<IRGen> gens(pool->size(), gen);
+  pool->run(func_def_l.size(), [&](unsigned worker, size_t i) {
+    stbs[worker].push();
+    func_def_l[i]->gen(gens[worker], &stbs[worker]);
+    stbs[worker].pop();
+  });
+  return {};
+}
+
+Operand FuncDefAST::gen(IRGen &gen, SymbolTable *stb) {
+  Function &func = gen.mod.funcs[gen.func_ids[*ident]];
+  func.name = *ident;
+  func.ret_int = func_type_id == static_cast<char>(INT);
+  func.nparams = func.ntemps = static_cast<int32_t>(fparam_l->size());
+  func.line = line;
+  gen.func = &func;
+  gen.frame_top = 0;
+  gen.var_temps.clear();
+  gen.var_temp.assign(fparam_l->size(), true);
+  gen.set_block(func.new_block());
+  int64_t offset = 0;
+  for (const auto &fparam : *fparam_l) {
+    auto fparam_ast = dynamic_cast<FuncFParamAST *>(fparam);
+    assert(fparam_ast);
+    if (fparam_ast->array)
+      stb->insertArray(fparam_ast->ident, fparam_ast->array, -++offset);
+    else
+      stb->insertVar(fparam_ast->ident, -++offset);
+  }
+  if (func.name == "main")
+    for (auto [addr, exp] : gen.global_inits) {
+      gen.line = exp->line;
+      gen.assign(Operand::mem(addr), exp->gen(gen, gen.globals));
+    }
+  block->gen(gen, stb);
+  gen.line = line;
+  gen.ret(func.ret_int ? Operand::imm(0) : Operand());
+  func.remove_unreachable();
+  return {};
+}
+
+Operand FuncFParamAST::gen([[maybe_unused]] IRGen &gen,
+                           [[maybe_unused]] SymbolTable *stb) {
+  return {};
+}
+
+Operand BlockAST::gen(IRGen &gen, SymbolTable *stb) {
+  int32_t frame_top = gen.frame_top;
+  stb->push();
+  for (const auto &item : *item_l)
+    item->gen(gen, stb);
+  stb->pop();
+  gen.frame_top = frame_top;
+  return {};
+}
+
+Operand DeclAST::gen(IRGen &gen, SymbolTable *stb) {
+  for (const auto &def : *def_l)
+    def->gen(gen, stb);
+  return {};
+}
+
+static void store(IRGen &gen, Operand base, Operand offset, Operand val) {
+  Inst inst(Op::STORE, {}, base, offset);
+  inst.args.push_back(val);
+  gen.emit(inst);
+}
+
+// Sets every element of a local array to zero with a loop.
+static void gen_zero(IRGen &gen, Operand base, int32_t size) {
+  Operand i = gen.new_temp(), cond = gen.new_temp();
+  gen.var_temp[i.val] = true;
+  gen.emit(Inst(Op::MOV, i, Operand::imm(0)));
+  int32_t head_block = gen.func->new_block();
+  int32_t body_block = gen.func->new_block();
+  int32_t end_block = gen.func->new_block();
+  gen.jump(head_block);
+  gen.set_block(head_block);
+  gen.emit(Inst(Op::BIN, cond, i, Operand::imm(size), '<'));
+  gen.branch(cond, body_block, end_block);
+  gen.set_block(body_block);
+  store(gen, base, i, Operand::imm(0));
+  gen.emit(Inst(Op::BIN, i, i, Operand::imm(1), '+'));
+  gen.jump(head_block);
+  gen.set_block(end_block);
+}
+
+// A local array takes the next cells of the frame, which the blocks after
+// its own reuse. The elements an initializer leaves out are zero, stored
+// one by one when they are few.
+static void gen_array(DefAST &def, IRGen &gen, SymbolTable *stb) {
+  constexpr int64_t max_zero_stores = 8;
+  Operand base = gen.new_temp();
+  gen.var_temp[base.val] = true;
+  stb->insertArray(def.ident, def.array);
+  gen.var_temps[stb->lookup(def.ident).offset] = base.val;
+  gen.emit(Inst(Op::FRAME, base, Operand::imm(gen.frame_top)));
+  auto size = static_cast<int32_t>(def.array->size());
+  if (safe_add(gen.frame_top, size) < gen.frame_top)
+    throw flea_compiler_error("local arrays too large");
+  gen.frame_top += size;
+  gen.func->frame_size = std::max(gen.func->frame_size, gen.frame_top);
+  if (!def.elems)
+    return;
+  bool zero_loop = size - static_cast<int64_t>(def.elems->size()) >
+                   max_zero_stores;
+  if (zero_loop)
+    gen_zero(gen, base, size);
+  int32_t next = 0;
+  for (const auto &elem : *def.elems) {
+    for (; !zero_loop && next < elem.index; ++next)
+      store(gen, base, Operand::imm(next), Operand::imm(0));
+    Operand val = elem.init->gen(gen, stb);
+    next = static_cast<int32_t>(elem.index) + 1;
+    if (!zero_loop || val != Operand::imm(0))
+      store(gen, base, Operand::imm(static_cast<int32_t>(elem.index)), val);
+  }
+  for (; !zero_loop && next < size; ++next)
+    store(gen, base, Operand::imm(next), Operand::imm(0));
+}
+
+Operand DefAST::gen(IRGen &gen, SymbolTable *stb) {
+  gen.line = line;
+  if (array) {
+    gen_array(*this, gen, stb);
+    return {};
+  }
+  if (is_const) {
+    auto num = dynamic_cast<NumberAST *>(init_val);
+    assert(num);
+    stb->insertConst(ident, num->number);
+    return {};
+  }
+  if (init_val) {
+    Operand val = init_val->gen(gen, stb);
+    stb->insertVar(ident);
+    gen.assign(gen.var(stb, ident), val);
+  } else
+    stb->insertVar(ident);
+  return {};
+}
+
+Operand InitValAST::gen(IRGen &gen, SymbolTable *stb) {
+  return exp->gen(gen, stb);
+}
+
+Operand ExpStmtAST::gen(IRGen &gen, SymbolTable *stb) {
+  gen.line = line;
+  return exp->gen(gen, stb), Operand();
+}
+
+Operand RetStmtAST::gen(IRGen &gen, SymbolTable *stb) {
+  gen.line = line;
+  gen.ret(exp->gen(gen, stb));
+  return {};
+}
+
+Operand BreakStmtAST::gen(IRGen &gen, [[maybe_unused]] SymbolTable *stb) {
+  gen.line = line;
+  gen.jump(gen.loops.back().second);
+  return {};
+}
+
+Operand ContinueStmtAST::gen(IRGen &gen, [[maybe_unused]] SymbolTable *stb) {
+  gen.line = line;
+  gen.jump(gen.loops.back().first);
+  return {};
+}
+
+Operand AssignStmtAST::gen(IRGen &gen, SymbolTable *stb) {
+  auto lval = dynamic_cast<LValAST *>(this->lval);
+  assert(lval);
+  gen.line = line;
+  Operand val = exp->gen(gen, stb);
+  if (const ArrayInfo *array = stb->lookup(lval->ident).array) {
+    Operand base = gen.array(stb, lval->ident);
+    store(gen, base, gen_offset(lval, gen, stb, *array), val);
+    return {};
+  }
+  gen.assign(gen.var(stb, lval->ident), val);
+  return {};
+}
+
+Operand IfStmtAST::gen(IRGen &gen, SymbolTable *stb) {
+  int32_t then_block = gen.func->new_block();
+  int32_t else_block = else_stmt ? gen.func->new_block() : -1;
+  int32_t end_block = gen.func->new_block();
+  gen.line = cond->line;
+  gen.branch(gen_cond(cond, gen, stb, true),
+             else_stmt ? else_block : end_block, then_block);
+  gen.set_block(then_block);
+  if (then_stmt)
+    then_stmt->gen(gen, stb);
+  gen.jump(end_block);
+  if (else_stmt) {
+    gen.set_block(else_block);
+    else_stmt->gen(gen, stb);
+    gen.jump(end_block);
+  }
+  gen.set_block(end_block);
+  return {};
+}
+
+Operand WhileStmtAST::gen(IRGen &gen, SymbolTable *stb) {
+  int32_t head_block = gen.func->new_block();
+  int32_t body_block = gen.func->new_block();
+  int32_t end_block = gen.func->new_block();
+  gen.jump(head_block);
+  gen.set_block(head_block);
+  gen.line = cond->line;
+  gen.branch(gen_cond(cond, gen, stb, true), end_block, body_block);
+  gen.set_block(body_block);
+  gen.loops.emplace_back(head_block, end_block);
+  if (stmt)
+    stmt->gen(gen, stb);
+  gen.loops.pop_back();
+  gen.jump(head_block);
+  gen.set_block(end_block);
+  return {};
+}
+
+Operand ExpAST::gen(IRGen &gen, SymbolTable *stb) { return exp->gen(gen, stb); }
+
+Operand PrimaryExpAST::gen(IRGen &gen, SymbolTable *stb) {
+  return exp->gen(gen, stb);
+}
+
+Operand LValAST::gen(IRGen &gen, SymbolTable *stb) {
+  const ArrayInfo *array = stb->lookup(ident).array;
+  if (!array)
+    return gen.var(stb, ident);
+  Operand base = gen.array(stb, ident);
+  Operand offset = gen_offset(this, gen, stb, *array);
+  if (!index_l || index_l->size() < array->dims.size())
+    return gen_bin(gen, '+', base, offset);
+  Operand dst = gen.new_temp();
+  gen.emit(Inst(Op::LOAD, dst, base, offset));
+  return dst;
+}
+
+Operand NumberAST::gen([[maybe_unused]] IRGen &gen,
+                       [[maybe_unused]] SymbolTable *stb) {
+  return Operand::imm(number);
+}
+
+Operand CallExpAST::gen(IRGen &gen, SymbolTable *stb) {
+  std::vector<Operand> args;
+  for (const auto &fparam : *fparam_l)
+    args.push_back(fparam->gen(gen, stb));
+  auto it = gen.func_ids.find(*ident);
+  if (it == gen.func_ids.end()) {
+    Operand dst;
+    if (*ident == "getint")
+      gen.emit(Inst(Op::GETI, dst = gen.new_temp()));
+    else if (*ident == "getch")
+      gen.emit(Inst(Op::GETC, dst = gen.new_temp()));
+    else if (*ident == "putint")
+      gen.emit(Inst(Op::PUTI, {}, args[0]));
+    else if (*ident == "putch")
+      gen.emit(Inst(Op::PUTC, {}, args[0]));
+    else
+      assert(false);
+    return dst;
+  }
+  Inst call(Op::CALL);
+  call.func = it->second;
+  call.args = std::move(args);
+  if (stb->lookupFunc(ident)->returnType == static_cast<char>(INT))
+    call.dst = gen.new_temp();
+  gen.emit(call);
+  return call.dst;
+}
+
+Operand UnaryExpAST::gen(IRGen &gen, SymbolTable *stb) {
+  Operand val = exp->gen(gen, stb);
+  if (unary_op == 0 || unary_op == '+')
+    return val;
+  if (val.is_imm())
+    return Operand::imm(unary_op == '-' ? safe_sub(0, val.val) : !val.val);
+  Operand dst = gen.new_temp();
+  gen.emit(Inst(Op::UN, dst, val, {}, unary_op));
+  return dst;
+}
+
+Operand BinExpAST::gen(IRGen &gen, SymbolTable *stb) {
+  if (!rhs)
+    return lhs->gen(gen, stb);
+  return gen_op(gen, stb, op);
+}
+
+// Sethi-Ullman number of an expression: the temporaries needed to evaluate
+// it, or -1 if it calls a function and so must keep its place in order.
+static int32_t need(BaseAST *ast) {
+  if (auto exp = dynamic_cast<ExpAST *>(ast))
+    return need(exp->exp);
+  if (auto exp = dynamic_cast<PrimaryExpAST *>(ast))
+    return need(exp->exp);
+  if (auto exp = dynamic_cast<UnaryExpAST *>(ast)) {
+    int32_t val = need(exp->exp);
+    return val == 0 && exp->unary_op != 0 && exp->unary_op != '+' ? 1 : val;
+  }
+  if (auto exp = dynamic_cast<BinExpAST *>(ast)) {
+    if (!exp->rhs)
+      return need(exp->lhs);
+    int32_t l = need(exp->lhs), r = need(exp->rhs);
+    if (l == -1 || r == -1)
+      return -1;
+    return l == r ? l + 1 : std::max(l, r);
+  }
+  if (dynamic_cast<CallExpAST *>(ast))
+    return -1;
+  if (auto lval = dynamic_cast<LValAST *>(ast); lval && lval->index_l) {
+    int32_t val = 1;
+    for (const auto &index : *lval->index_l) {
+      int32_t n = need(index);
+      if (n == -1)
+        return -1;
+      val = std::max(val, n + 1);
+    }
+    return val;
+  }
+  return 0;
+}
+
+Operand BinExpAST::gen_op(IRGen &gen, SymbolTable *stb, char op) {
+  // the operand needing more temporaries goes first, so that fewer values
+  // are live at once while the other one is evaluated
+  Operand a, b;
+  int32_t l = need(lhs), r = need(rhs);
+  if (l != -1 && r != -1 && r > l)
+    b = rhs->gen(gen, stb), a = lhs->gen(gen, stb);
+  else
+    a = lhs->gen(gen, stb), b = rhs->gen(gen, stb);
+  Operand dst = gen.new_temp();
+  gen.emit(Inst(Op::BIN, dst, a, b, op));
+  return dst;
+}
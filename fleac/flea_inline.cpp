@@ -0,0 +1,207 @@
+#include "flea_opt.hpp"
+#include <algorithm>
+#include <iterator>
+
+// Calls of the IR functions, which are the FuncDefASTs of func_def_l in
+// order, and the Tarjan strongly connected components of that graph.
+struct CallGraph {
+  std::vector<std::vector<int32_t>> callees;
+  std::vector<int32_t> sites, scc, order;
+  std::vector<char> recursive;
+  std::vector<int32_t> index, low, stack;
+  int32_t counter = 0;
+
+  CallGraph(const Module &mod)
+      : callees(mod.funcs.size()), sites(mod.funcs.size()),
+        scc(mod.funcs.size(), -1), recursive(mod.funcs.size()),
+        index(mod.funcs.size(), -1), low(mod.funcs.size()) {
+    for (size_t f = 0; f < mod.funcs.size(); ++f)
+      for (const auto &block : mod.funcs[f].blocks)
+        for (const auto &inst : block.insts)
+          if (inst.op == Op::CALL) {
+            callees[f].push_back(inst.func);
+            ++sites[inst.func];
+            recursive[f] |= inst.func == static_cast<int32_t>(f);
+          }
+    for (int32_t f = 0; f < static_cast<int32_t>(mod.funcs.size()); ++f)
+      if (index[f] == -1)
+        visit(f);
+  }
+
+  // Emits the components callees first into order.
+  void visit(int32_t f) {
+    index[f] = low[f] = counter++;
+    stack.push_back(f);
+    for (int32_t g : callees[f]) {
+      if (index[g] == -1) {
+        visit(g);
+        low[f] = std::min(low[f], low[g]);
+      } else if (scc[g] == -1)
+        low[f] = std::min(low[f], index[g]);
+    }
+    if (low[f] != index[f])
+      return;
+    auto top = std::find(stack.begin(), stack.end(), f);
+    for (auto it = top; it != stack.end(); ++it) {
+      scc[*it] = f;
+      order.push_back(*it);
+      recursive[*it] |= stack.end() - top > 1;
+    }
+    stack.erase(top, stack.end());
+  }
+};
+
+// Size estimate of a function in IR instructions and terminators.
+static int32_t cost(const Function &func) {
+  int32_t size = 0;
+  for (const auto &block : func.blocks)
+    size += static_cast<int32_t>(block.insts.size()) + 1;
+  return size;
+}
+
+// Replaces the call insts[k] of block b by a copy of the callee's body: the
+// arguments are moved into the callee's parameter temporaries, returns jump
+// to a new block holding the rest of b. The callee's local arrays go after
+// the caller's.
+static void inline_call(Function &caller, const Function &callee, int32_t b,
+                        size_t k) {
+  Inst call = std::move(caller.blocks[b].insts[k]);
+  int32_t temps = caller.ntemps, frame = caller.frame_size;
+  caller.ntemps += callee.ntemps;
+  caller.frame_size += callee.frame_size;
+  auto base = static_cast<int32_t>(caller.blocks.size());
+  auto rest_id = base + static_cast<int32_t>(callee.blocks.size());
+  caller.blocks.resize(caller.blocks.size() + callee.blocks.size() + 1);
+  Block &head = caller.blocks[b], &rest = caller.blocks[rest_id];
+  rest.insts.assign(std::make_move_iterator(head.insts.begin() + k + 1),
+                    std::make_move_iterator(head.insts.end()));
+  rest.term = head.term, rest.cond = head.cond;
+  rest.succ[0] = head.succ[0], rest.succ[1] = head.succ[1];
+  head.insts.erase(head.insts.begin() + k, head.insts.end());
+  for (int32_t i = 0; i < callee.nparams; ++i)
+    head.insts.emplace_back(Op::MOV, Operand::temp(temps + i), call.args[i]);
+  head.term = Block::JMP, head.cond = Operand(), head.succ[0] = base;
+
+  auto remap = [&](Operand &opd) {
+    if (opd.is_temp())
+      opd.val += temps;
+  };
+  for (size_t j = 0; j < callee.blocks.size(); ++j) {
+    Block block = callee.blocks[j];
+    for (auto &inst : block.insts) {
+      remap(inst.dst), remap(inst.a), remap(inst.b);
+      for (auto &arg : inst.args)
+        remap(arg);
+      if (inst.op == Op::FRAME)
+        inst.a.val += frame;
+    }
+    remap(block.cond);
+    for (int32_t s = 0; s < block.succ_count(); ++s)
+      block.succ[s] += base;
+    if (block.term == Block::RET) {
+      if (call.dst.kind != Operand::NONE && block.cond.kind != Operand::NONE)
+        block.insts.emplace_back(Op::MOV, call.dst, block.cond);
+      block.term = Block::JMP, block.cond = Operand();
+      block.succ[0] = rest_id;
+    }
+    caller.blocks[base + j] = std::move(block);
+  }
+}
+
+// Drops the functions main no longer calls and renumbers the rest.
+static void remove_dead_funcs(Module &mod) {
+  std::vector<int32_t> remap(mod.funcs.size(), -1), work = {mod.main_id};
+  remap[mod.main_id] = 0;
+  while (!work.empty()) {
+    int32_t f = work.back();
+    work.pop_back();
+    for (const auto &block : mod.funcs[f].blocks)
+      for (const auto &inst : block.insts)
+        if (inst.op == Op::CALL && remap[inst.func] == -1)
+          remap[inst.func] = 0, work.push_back(inst.func);
+  }
+  std::vector<Function> kept;
+  for (size_t f = 0; f < mod.funcs.size(); ++f)
+    if (remap[f] != -1) {
+      remap[f] = static_cast<int32_t>(kept.size());
+      kept.push_back(std::move(mod.funcs[f]));
+    }
+  for (auto &func : kept)
+    for (auto &block : func.blocks)
+      for (auto &inst : block.insts)
+        if (inst.op == Op::CALL)
+          inst.func = remap[inst.func];
+  mod.main_id = remap[mod.main_id];
+  mod.funcs = std::move(kept);
+}
+
+// A parameter that every call site passes the same constant becomes that
+// constant inside the function, for the optimizer to propagate.
+static void specialize_params(Module &mod) {
+  std::vector<std::vector<Operand>> vals(mod.funcs.size());
+  std::vector<std::vector<char>> varies(mod.funcs.size());
+  for (size_t f = 0; f < mod.funcs.size(); ++f)
+    vals[f].resize(mod.funcs[f].nparams),
+        varies[f].assign(mod.funcs[f].nparams, 0);
+  for (const auto &func : mod.funcs)
+    for (const auto &block : func.blocks)
+      for (const auto &inst : block.insts) {
+        if (inst.op != Op::CALL)
+          continue;
+        for (size_t i = 0; i < inst.args.size(); ++i) {
+          Operand &val = vals[inst.func][i];
+          if (!inst.args[i].is_imm() ||
+              (val.kind != Operand::NONE && val != inst.args[i]))
+            varies[inst.func][i] = 1;
+          val = inst.args[i];
+        }
+      }
+  for (size_t f = 0; f < mod.funcs.size(); ++f) {
+    Function &func = mod.funcs[f];
+    auto &entry = func.blocks[0].insts;
+    for (int32_t i = 0; i < func.nparams; ++i)
+      if (!varies[f][i] && vals[f][i].is_imm())
+        entry.insert(entry.begin(),
+                     Inst(Op::MOV, Operand::temp(i), vals[f][i]));
+  }
+}
+
+// How many times the threshold inlining may add to a caller, so that a
+// chain of functions called once does not all end up in one.
+static constexpr int32_t caller_growth = 64;
+
+void inline_calls(Module &mod, int32_t threshold) {
+  CallGraph graph(mod);
+  for (int32_t f : graph.order) {
+    Function &caller = mod.funcs[f];
+    int32_t size = cost(caller), budget = size + caller_growth * threshold;
+    for (size_t b = 0; b < caller.blocks.size(); ++b)
+      for (size_t k = 0; k < caller.blocks[b].insts.size(); ++k) {
+        const Inst &inst = caller.blocks[b].insts[k];
+        if (inst.op != Op::CALL || graph.recursive[inst.func] ||
+            graph.scc[inst.func] == graph.scc[f])
+          continue;
+        const Function &callee = mod.funcs[inst.func];
+        // constant arguments are likely to fold away much of the body
+        auto consts = std::count_if(
+            inst.args.begin(), inst.args.end(),
+            [](const Operand &arg) { return arg.is_imm(); });
+        int32_t callee_size = cost(callee);
+        if ((graph.sites[inst.func] != 1 &&
+             callee_size > threshold + 4 * static_cast<int32_t>(consts)) ||
+            size + callee_size > budget)
+          continue;
+        size += callee_size + callee.nparams;
+        --graph.sites[inst.func];
+        for (const auto &block : callee.blocks)
+          for (const auto &call : block.insts)
+            if (call.op == Op::CALL)
+              ++graph.sites[call.func];
+        inline_call(caller, callee, static_cast<int32_t>(b), k);
+        break;
+      }
+    caller.remove_unreachable();
+  }
+  remove_dead_funcs(mod);
+  specialize_params(mod);
+}
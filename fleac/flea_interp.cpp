@@ -0,0 +1,182 @@
+#include "flea_interp.hpp"
+#include "flea_opt.hpp"
+
+thread_local std::map<std::pair<const FuncDefAST *, std::vector<int32_t>>,
+                      std::optional<int32_t>>
+    Interp::results;
+
+void Interp::forget() { results.clear(); }
+
+std::optional<int32_t> Interp::call(FuncDefAST &func,
+                                    const std::vector<int32_t> &args) {
+  if (auto it = results.find({&func, args}); it != results.end())
+    return it->second;
+  steps = 0, depth = 0, frame = 0;
+  scopes.clear();
+  try {
+    return invoke(func, args);
+  } catch (const give_up &) {
+    return results[{&func, args}] = std::nullopt;
+  }
+}
+
+void Interp::step() {
+  if (++steps > step_budget)
+    throw give_up();
+}
+
+std::optional<int32_t> *Interp::find(Ident name) {
+  for (size_t i = scopes.size(); i-- > frame;)
+    if (auto it = scopes[i].find(name.id); it != scopes[i].end())
+      return &it->second;
+  return nullptr;
+}
+
+int32_t Interp::invoke(FuncDefAST &func, const std::vector<int32_t> &args) {
+  if (auto it = results.find({&func, args}); it != results.end()) {
+    if (!it->second)
+      throw give_up();
+    return *it->second;
+  }
+  if (++depth > depth_budget || args.size() != func.fparam_l->size())
+    throw give_up();
+  size_t caller = frame;
+  frame = scopes.size();
+  Scope &params = scopes.emplace_back();
+  for (size_t i = 0; i < args.size(); ++i) {
+    auto fparam = dynamic_cast<FuncFParamAST *>((*func.fparam_l)[i]);
+    params[fparam->ident.id] = args[i];
+  }
+  // falling off the end of an int function returns 0, as in IRGen
+  int32_t result = exec(func.block) == Flow::RETURN ? ret : 0;
+  scopes.resize(frame);
+  frame = caller, --depth;
+  results[{&func, args}] = result;
+  return result;
+}
+
+Interp::Flow Interp::exec(BaseAST *ast) {
+  step();
+  if (auto block = dynamic_cast<BlockAST *>(ast)) {
+    scopes.emplace_back();
+    Flow flow = Flow::NEXT;
+    for (const auto &item : *block->item_l)
+      if ((flow = exec(item)) != Flow::NEXT)
+        break;
+    scopes.pop_back();
+    return flow;
+  }
+  if (auto decl = dynamic_cast<DeclAST *>(ast)) {
+    for (const auto &def : *decl->def_l) {
+      auto def_ast = dynamic_cast<DefAST *>(def);
+      if (def_ast->dim_l)
+        throw give_up(); // arrays live in memory
+      std::optional<int32_t> val;
+      if (def_ast->init_val)
+        val = eval(def_ast->init_val);
+      scopes.back()[def_ast->ident.id] = val;
+    }
+    return Flow::NEXT;
+  }
+  if (auto stmt = dynamic_cast<ExpStmtAST *>(ast))
+    return eval(stmt->exp), Flow::NEXT;
+  if (auto stmt = dynamic_cast<RetStmtAST *>(ast))
+    return ret = eval(stmt->exp), Flow::RETURN;
+  if (dynamic_cast<BreakStmtAST *>(ast))
+    return Flow::BREAK;
+  if (dynamic_cast<ContinueStmtAST *>(ast))
+    return Flow::CONTINUE;
+  if (auto stmt = dynamic_cast<AssignStmtAST *>(ast)) {
+    int32_t val = eval(stmt->exp);
+    auto lval = dynamic_cast<LValAST *>(stmt->lval);
+    auto var = lval->index_l ? nullptr : find(lval->ident);
+    if (!var)
+      throw give_up(); // a global or an array element
+    *var = val;
+    return Flow::NEXT;
+  }
+  if (auto stmt = dynamic_cast<IfStmtAST *>(ast)) {
+    BaseAST *branch = eval(stmt->cond) ? stmt->then_stmt
+                                             : stmt->else_stmt;
+    return branch ? exec(branch) : Flow::NEXT;
+  }
+  if (auto stmt = dynamic_cast<WhileStmtAST *>(ast)) {
+    while (eval(stmt->cond)) {
+      step();
+      Flow flow = stmt->stmt ? exec(stmt->stmt) : Flow::NEXT;
+      if (flow == Flow::BREAK)
+        break;
+      if (flow == Flow::RETURN)
+        return flow;
+    }
+    return Flow::NEXT;
+  }
+  throw give_up();
+}
+
+// Of the arrays, only the elements of the const globals are known.
+int32_t Interp::element(LValAST *lval) {
+  const Symbol &sym = globals->lookupGlobal(lval->ident);
+  if (find(lval->ident) || !sym.array || !sym.array->is_const ||
+      lval->index_l->size() != sym.array->dims.size())
+    throw give_up();
+  int64_t index = 0;
+  for (size_t d = 0; d < lval->index_l->size(); ++d) {
+    int32_t val = eval((*lval->index_l)[d]);
+    if (val < 0 || val >= sym.array->dims[d])
+      throw give_up();
+    index += val * sym.array->stride(d);
+  }
+  return sym.array->values[static_cast<size_t>(index)];
+}
+
+int32_t Interp::eval(BaseAST *ast) {
+  if (auto exp = dynamic_cast<ExpAST *>(ast))
+    return eval(exp->exp);
+  if (auto exp = dynamic_cast<PrimaryExpAST *>(ast))
+    return eval(exp->exp);
+  if (auto exp = dynamic_cast<InitValAST *>(ast))
+    return eval(exp->exp);
+  if (auto num = dynamic_cast<NumberAST *>(ast))
+    return num->number;
+  if (auto lval = dynamic_cast<LValAST *>(ast)) {
+    if (lval->index_l)
+      return element(lval);
+    if (auto var = find(lval->ident)) {
+      if (!*var)
+        throw give_up(); // read before written
+      return **var;
+    }
+    const Symbol &sym = globals->lookupGlobal(lval->ident);
+    if (sym.kind != Symbol::CONST)
+      throw give_up();
+    return sym.value;
+  }
+  if (auto exp = dynamic_cast<UnaryExpAST *>(ast)) {
+    int32_t val = eval(exp->exp), result = val;
+    if (exp->unary_op == '-' || exp->unary_op == '!')
+      fold(exp->unary_op, true, val, 0, result);
+    return result;
+  }
+  if (auto exp = dynamic_cast<BinExpAST *>(ast)) {
+    int32_t lhs = eval(exp->lhs), result;
+    if (!exp->rhs)
+      return lhs;
+    int32_t rhs = eval(exp->rhs);
+    if (!fold(exp->op, false, lhs, rhs, result))
+      throw give_up(); // traps at run time
+    return result;
+  }
+  if (auto exp = dynamic_cast<CallExpAST *>(ast)) {
+    step();
+    const FuncSign *sign = globals->lookupGlobal(exp->ident).func;
+    auto func = sign ? dynamic_cast<FuncDefAST *>(sign->def) : nullptr;
+    if (!func)
+      throw give_up(); // a built-in, which does I/O
+    std::vector<int32_t> args;
+    for (const auto &arg : *exp->fparam_l)
+      args.push_back(eval(arg));
+    return invoke(*func, args);
+  }
+  throw give_up();
+}
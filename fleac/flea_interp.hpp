@@ -0,0 +1,49 @@
+#ifndef FLEA_INTERP_HPP_FLAG
+#define FLEA_INTERP_HPP_FLAG
+
+#include "flea_ast.hpp"
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Runs calls to pure functions at compile time by walking their AST. A pure
+// function does no I/O and neither reads nor writes global variables, so
+// its result depends on its arguments alone and is kept until forget is
+// called. Evaluation gives up, leaving the call for run time, on anything
+// else and on running out of steps or call depth. The results are kept per
+// thread and forgotten before each function is checked, so that what gets
+// folded does not depend on which thread checked what.
+class Interp {
+public:
+  static constexpr int64_t step_budget = 1 << 18;
+  static constexpr int32_t depth_budget = 256;
+  Interp(const SymbolTable *globals) : globals(globals) {}
+  std::optional<int32_t> call(FuncDefAST &func,
+                              const std::vector<int32_t> &args);
+  static void forget();
+
+private:
+  enum class Flow { NEXT, BREAK, CONTINUE, RETURN };
+  struct give_up {};
+  using Scope = std::unordered_map<int32_t, std::optional<int32_t>>;
+  // results by function and arguments, nullopt where evaluation gave up
+  static thread_local std::map<
+      std::pair<const FuncDefAST *, std::vector<int32_t>>,
+      std::optional<int32_t>>
+      results;
+  const SymbolTable *globals;
+  int64_t steps = 0;
+  int32_t depth = 0, ret = 0;
+  // scopes of the calls in progress; those of the innermost start at frame
+  std::vector<Scope> scopes;
+  size_t frame = 0;
+  void step();
+  std::optional<int32_t> *find(Ident name);
+  int32_t invoke(FuncDefAST &func, const std::vector<int32_t> &args);
+  Flow exec(BaseAST *ast);
+  int32_t eval(BaseAST *ast);
+  int32_t element(LValAST *lval);
+};
+
+#endif // FLEA_INTERP_HPP_FLAG
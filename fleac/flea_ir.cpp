@@ -0,0 +1,281 @@
+#include "flea_ir.hpp"
+#include "flea_expr.hpp"
+#include "flea_sym.hpp"
+#include <algorithm>
+#include <cassert>
+
+void Function::compute_preds() {
+  for (auto &block : blocks)
+    block.preds.clear();
+  for (int32_t i = 0; i < static_cast<int32_t>(blocks.size()); ++i) {
+    const Block &block = blocks[i];
+    for (int32_t k = 0; k < block.succ_count(); ++k)
+      blocks[block.succ[k]].preds.push_back(i);
+  }
+}
+
+void Function::remove_unreachable() {
+  std::vector<int32_t> remap(blocks.size(), -1), stack = {0};
+  remap[0] = 0;
+  while (!stack.empty()) {
+    const Block &block = blocks[stack.back()];
+    stack.pop_back();
+    for (int32_t k = 0; k < block.succ_count(); ++k)
+      if (remap[block.succ[k]] == -1)
+        remap[block.succ[k]] = 0, stack.push_back(block.succ[k]);
+  }
+  int32_t count = 0;
+  for (size_t i = 0; i < blocks.size(); ++i)
+    if (remap[i] != -1)
+      remap[i] = count++;
+  std::vector<Block> kept;
+  kept.reserve(count);
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    if (remap[i] == -1)
+      continue;
+    kept.push_back(std::move(blocks[i]));
+    Block &block = kept.back();
+    for (int32_t k = 0; k < block.succ_count(); ++k)
+      block.succ[k] = remap[block.succ[k]];
+  }
+  blocks = std::move(kept);
+  compute_preds();
+  for (auto &block : blocks)
+    for (auto &inst : block.insts) {
+      if (inst.op != Op::PHI)
+        break;
+      size_t k = 0;
+      for (size_t i = 0; i < inst.from.size(); ++i) {
+        int32_t from = remap[inst.from[i]];
+        if (from == -1 || std::find(block.preds.begin(), block.preds.end(),
+                                    from) == block.preds.end())
+          continue;
+        inst.from[k] = from, inst.args[k++] = inst.args[i];
+      }
+      inst.from.resize(k), inst.args.resize(k);
+    }
+}
+
+std::vector<int32_t> Function::rpo() const {
+  std::vector<int32_t> order;
+  std::vector<char> seen(blocks.size());
+  std::vector<std::pair<int32_t, int32_t>> stack = {{0, 0}};
+  seen[0] = 1;
+  while (!stack.empty()) {
+    auto &[id, k] = stack.back();
+    const Block &block = blocks[id];
+    if (k == block.succ_count()) {
+      order.push_back(id);
+      stack.pop_back();
+      continue;
+    }
+    int32_t next = block.succ[k++];
+    if (!seen[next])
+      seen[next] = 1, stack.emplace_back(next, 0);
+  }
+  return std::vector<int32_t>(order.rbegin(), order.rend());
+}
+
+// Cooper, Harvey and Kennedy's iterative dominator algorithm.
+std::vector<int32_t> Function::idom() const {
+  std::vector<int32_t> order = rpo(), index(blocks.size(), -1);
+  for (size_t i = 0; i < order.size(); ++i)
+    index[order[i]] = static_cast<int32_t>(i);
+  std::vector<int32_t> dom(blocks.size(), -1);
+  dom[0] = 0;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t i = 1; i < order.size(); ++i) {
+      int32_t id = order[i], new_dom = -1;
+      for (int32_t pred : blocks[id].preds) {
+        if (dom[pred] == -1)
+          continue;
+        if (new_dom == -1) {
+          new_dom = pred;
+          continue;
+        }
+        int32_t a = pred, b = new_dom;
+        while (a != b) {
+          while (index[a] > index[b])
+            a = dom[a];
+          while (index[b] > index[a])
+            b = dom[b];
+        }
+        new_dom = a;
+      }
+      if (dom[id] != new_dom)
+        dom[id] = new_dom, changed = true;
+    }
+  }
+  return dom;
+}
+
+// print functions
+
+std::ostream &operator<<(std::ostream &out, const Operand &opd) {
+  switch (opd.kind) {
+  case Operand::NONE:
+    return out << "_";
+  case Operand::IMM:
+    return out << "@" << opd.val;
+  case Operand::TEMP:
+    return out << "t" << opd.val;
+  case Operand::MEM:
+    return out << "$" << opd.val;
+  }
+  __builtin_unreachable();
+}
+
+std::ostream &operator<<(std::ostream &out, const Inst &inst) {
+  switch (inst.op) {
+  case Op::MOV:
+    return out << inst.dst << " = " << inst.a;
+  case Op::BIN:
+    return out << inst.dst << " = " << inst.a << " " << id2op(inst.sub) << " "
+               << inst.b;
+  case Op::UN:
+    return out << inst.dst << " = " << inst.sub << inst.a;
+  case Op::FRAME:
+    return out << inst.dst << " = frame " << inst.a.val;
+  case Op::LOAD:
+    return out << inst.dst << " = [" << inst.a << " + " << inst.b << "]";
+  case Op::STORE:
+    return out << "[" << inst.a << " + " << inst.b << "] = " << inst.args[0];
+  case Op::CHECK:
+    return out << "check " << inst.a << " < " << inst.b;
+  case Op::PHI:
+    out << inst.dst << " = phi";
+    for (size_t i = 0; i < inst.args.size(); ++i)
+      out << (i ? ", b" : " b") << inst.from[i] << ":" << inst.args[i];
+    return out;
+  case Op::CALL:
+    if (inst.dst.kind != Operand::NONE)
+      out << inst.dst << " = ";
+    out << (inst.tail ? "tail call f" : "call f") << inst.func << "(";
+    for (size_t i = 0; i < inst.args.size(); ++i)
+      out << (i ? ", " : "") << inst.args[i];
+    return out << ")";
+  case Op::GETI:
+    return out << inst.dst << " = geti";
+  case Op::GETC:
+    return out << inst.dst << " = getc";
+  case Op::PUTI:
+    return out << "puti " << inst.a;
+  case Op::PUTC:
+    return out << "putc " << inst.a;
+  }
+  __builtin_unreachable();
+}
+
+std::ostream &operator<<(std::ostream &out, const Function &func) {
+  out << (func.ret_int ? "int " : "void ") << func.name << "(" << func.nparams
+      << ") {\n";
+  if (func.frame_size)
+    out << "frame " << func.frame_size << "\n";
+  for (size_t i = 0; i < func.blocks.size(); ++i) {
+    const Block &block = func.blocks[i];
+    out << "b" << i << ":";
+    for (int32_t pred : block.preds)
+      out << " b" << pred;
+    out << "\n";
+    for (const auto &inst : block.insts)
+      out << "  " << inst << "\n";
+    switch (block.term) {
+    case Block::JMP:
+      out << "  jmp b" << block.succ[0] << "\n";
+      break;
+    case Block::BR:
+      out << "  br " << block.cond << " b" << block.succ[0] << " b"
+          << block.succ[1] << "\n";
+      break;
+    case Block::RET:
+      out << "  ret " << block.cond << "\n";
+      break;
+    }
+  }
+  return out << "}";
+}
+
+std::ostream &operator<<(std::ostream &out, const Module &mod) {
+  out << "data " << mod.data.size() << "\n";
+  for (size_t i = 0; i < mod.funcs.size(); ++i)
+    out << "f" << i << ": " << mod.funcs[i] << "\n";
+  return out;
+}
+
+// IRGen functions
+
+Operand IRGen::new_temp() {
+  var_temp.push_back(false);
+  return Operand::temp(func->new_temp());
+}
+
+Operand IRGen::var(SymbolTable *stb, Ident name) {
+  const Symbol &sym = stb->lookup(name);
+  if (sym.kind == Symbol::CONST)
+    return Operand::imm(sym.value);
+  int64_t offset = sym.offset;
+  if (offset < 0)
+    return Operand::temp(static_cast<int32_t>(-offset - 1));
+  if (offset < global_count)
+    return Operand::mem(static_cast<int32_t>(offset));
+  auto it = var_temps.find(offset);
+  if (it != var_temps.end())
+    return Operand::temp(it->second);
+  Operand temp = new_temp();
+  var_temp[temp.val] = true;
+  var_temps[offset] = temp.val;
+  return temp;
+}
+
+// The address of an array: a parameter holds it, a global's is its offset
+// and a local's was taken into a temporary where it was defined.
+Operand IRGen::array(SymbolTable *stb, Ident name) {
+  int64_t offset = stb->lookup(name).offset;
+  if (offset < 0)
+    return Operand::temp(static_cast<int32_t>(-offset - 1));
+  if (offset < global_count)
+    return Operand::imm(static_cast<int32_t>(offset));
+  return Operand::temp(var_temps.at(offset));
+}
+
+void IRGen::emit(const Inst &inst) {
+  block().insts.push_back(inst);
+  block().insts.back().line = line;
+}
+
+void IRGen::assign(Operand dst, Operand val) {
+  auto &insts = block().insts;
+  if (val.is_temp() && !var_temp[val.val] &&
+      !insts.empty() && insts.back().dst == val) {
+    insts.back().dst = dst;
+    return;
+  }
+  if (dst != val)
+    emit(Inst(Op::MOV, dst, val));
+}
+
+void IRGen::jump(int32_t target) {
+  block().term = Block::JMP;
+  block().line = line;
+  block().succ[0] = target;
+  cur = func->new_block();
+}
+
+void IRGen::branch(Operand cond, int32_t then_block, int32_t else_block) {
+  if (cond.is_imm())
+    return jump(cond.val ? then_block : else_block);
+  block().term = Block::BR;
+  block().line = line;
+  block().cond = cond;
+  block().succ[0] = then_block;
+  block().succ[1] = else_block;
+  cur = func->new_block();
+}
+
+void IRGen::ret(Operand val) {
+  block().term = Block::RET;
+  block().line = line;
+  block().cond = val;
+  cur = func->new_block();
+}
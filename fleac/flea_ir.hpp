@@ -0,0 +1,133 @@
+#ifndef FLEA_IR_HPP_FLAG
+#define FLEA_IR_HPP_FLAG
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// An operand is an immediate, a function-local temporary or a global cell.
+struct Operand {
+  enum Kind : char { NONE, IMM, TEMP, MEM };
+  Kind kind = NONE;
+  int32_t val = 0;
+  Operand() {}
+  Operand(Kind kind, int32_t val) : kind(kind), val(val) {}
+  static Operand imm(int32_t val) { return Operand(IMM, val); }
+  static Operand temp(int32_t id) { return Operand(TEMP, id); }
+  static Operand mem(int32_t addr) { return Operand(MEM, addr); }
+  bool is_imm() const { return kind == IMM; }
+  bool is_temp() const { return kind == TEMP; }
+  bool operator==(const Operand &other) const {
+    return kind == other.kind && val == other.val;
+  }
+  bool operator!=(const Operand &other) const { return !(*this == other); }
+};
+
+// BIN uses the operator ids of BinExpAST in sub, UN those of UnaryExpAST.
+// PHI takes args[i] when control arrives from block from[i]. A tail CALL
+// ends a block that returns its result and may reuse the caller's frame.
+// FRAME gives the address of cell a of the function's local arrays, LOAD
+// reads the cell at address a + b and STORE writes args[0] to it. CHECK
+// stops the program unless 0 <= a < b.
+enum class Op : char {
+  MOV, BIN, UN, PHI, FRAME, LOAD,
+  CALL, GETI, GETC, PUTI, PUTC, STORE, CHECK
+};
+
+struct Inst {
+  Op op;
+  char sub = 0;
+  Operand dst, a, b;
+  int32_t func = -1;
+  std::vector<Operand> args;
+  std::vector<int32_t> from;
+  bool tail = false;
+  // the source line, 0 if unknown
+  int32_t line = 0;
+  Inst(Op op, Operand dst = {}, Operand a = {}, Operand b = {}, char sub = 0)
+      : op(op), sub(sub), dst(dst), a(a), b(b) {}
+  bool has_side_effect() const { return op >= Op::CALL; }
+};
+
+// A basic block ends with a jump, a two-way branch (succ[0] if cond is
+// non-zero, succ[1] otherwise) or a return of cond, made on source line.
+struct Block {
+  enum Term : char { JMP, BR, RET };
+  std::vector<Inst> insts;
+  Term term = RET;
+  Operand cond;
+  int32_t succ[2] = {-1, -1};
+  int32_t line = 0;
+  std::vector<int32_t> preds;
+  int32_t succ_count() const { return term == RET ? 0 : term == JMP ? 1 : 2; }
+};
+
+// Temporaries 0 .. nparams - 1 hold the parameters on entry; the local
+// arrays take frame_size cells of the frame. The source line is that of
+// the closing brace.
+struct Function {
+  std::string name;
+  bool ret_int = false;
+  int32_t nparams = 0, ntemps = 0, frame_size = 0, line = 0;
+  std::vector<Block> blocks;
+  int32_t new_temp() { return ntemps++; }
+  int32_t new_block() {
+    blocks.emplace_back();
+    return static_cast<int32_t>(blocks.size() - 1);
+  }
+  void compute_preds();
+  void remove_unreachable();
+  std::vector<int32_t> rpo() const;
+  std::vector<int32_t> idom() const;
+  friend std::ostream &operator<<(std::ostream &out, const Function &func);
+};
+
+// Globals occupy memory from address 0; the stack starts right after them.
+struct Module {
+  std::vector<int32_t> data;
+  std::vector<Function> funcs;
+  int32_t main_id = -1;
+  friend std::ostream &operator<<(std::ostream &out, const Module &mod);
+};
+
+class BaseAST;
+class SymbolTable;
+struct Ident;
+
+// State of the AST to IR lowering.
+class IRGen {
+public:
+  Module &mod;
+  Function *func = nullptr;
+  int32_t cur = -1;
+  // the source line of what is being lowered
+  int32_t line = 0;
+  int64_t global_count = 0;
+  SymbolTable *globals = nullptr;
+  std::vector<std::pair<int32_t, BaseAST *>> global_inits;
+  std::unordered_map<std::string, int32_t> func_ids;
+  std::unordered_map<int64_t, int32_t> var_temps;
+  std::vector<bool> var_temp;
+  std::vector<std::pair<int32_t, int32_t>> loops;
+  // the first cell of the local arrays not taken by an enclosing block
+  int32_t frame_top = 0;
+  bool bounds_check = false;
+  IRGen(Module &mod) : mod(mod) {}
+  Block &block() { return func->blocks[cur]; }
+  Operand new_temp();
+  Operand var(SymbolTable *stb, Ident name);
+  Operand array(SymbolTable *stb, Ident name);
+  void emit(const Inst &inst);
+  void assign(Operand dst, Operand val);
+  void jump(int32_t target);
+  void branch(Operand cond, int32_t then_block, int32_t else_block);
+  void ret(Operand val);
+  void set_block(int32_t id) { cur = id; }
+};
+
+std::ostream &operator<<(std::ostream &out, const Operand &opd);
+std::ostream &operator<<(std::ostream &out, const Inst &inst);
+
+#endif // FLEA_IR_HPP_FLAG
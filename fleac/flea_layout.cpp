@@ -0,0 +1,112 @@
+#include "flea_opt.hpp"
+#include <algorithm>
+
+// Blocks up to this size are copied into a predecessor that jumps to them.
+constexpr size_t dup_limit = 8;
+
+// Follows the chain of empty blocks that only jump, and of empty blocks
+// that branch on the same condition as the branch taking arm k of from.
+static int32_t thread(const Function &func, int32_t from, int32_t k) {
+  const Block &block = func.blocks[from];
+  int32_t target = block.succ[k];
+  for (size_t steps = 0; steps < func.blocks.size(); ++steps) {
+    const Block &next = func.blocks[target];
+    if (!next.insts.empty())
+      break;
+    if (next.term == Block::JMP && next.succ[0] != target)
+      target = next.succ[0];
+    else if (block.term == Block::BR && next.term == Block::BR &&
+             next.cond == block.cond && next.succ[k] != target)
+      target = next.succ[k];
+    else
+      break;
+  }
+  return target;
+}
+
+// Lays the blocks out for the VM, where falling through costs nothing and
+// every taken jump does:
+// - jumps through empty blocks go straight to their final target;
+// - a jump to a small block ending in a branch or return gets a copy of
+//   that block, which rotates loops into bottom-tested form;
+// - blocks are chained so that each falls through to its likely successor,
+//   the arm a branch takes when its (negated) condition is zero;
+// - a branch whose taken arm ends up next has its comparison inverted.
+void layout(Function &func) {
+  for (int32_t b = 0; b < static_cast<int32_t>(func.blocks.size()); ++b)
+    for (int32_t k = 0; k < func.blocks[b].succ_count(); ++k)
+      func.blocks[b].succ[k] = thread(func, b, k);
+  func.compute_preds();
+  for (auto &block : func.blocks) {
+    if (block.term != Block::JMP)
+      continue;
+    const Block &succ = func.blocks[block.succ[0]];
+    if (&succ == &block || succ.term == Block::JMP ||
+        succ.insts.size() > dup_limit || succ.preds.size() < 2)
+      continue;
+    block.insts.insert(block.insts.end(), succ.insts.begin(),
+                       succ.insts.end());
+    block.term = succ.term, block.cond = succ.cond;
+    block.succ[0] = succ.succ[0], block.succ[1] = succ.succ[1];
+  }
+  func.remove_unreachable();
+
+  auto n = func.blocks.size();
+  std::vector<int32_t> order;
+  std::vector<char> placed(n);
+  std::vector<int32_t> pending = {0};
+  while (!pending.empty()) {
+    int32_t b = pending.back();
+    pending.pop_back();
+    while (!placed[b]) {
+      placed[b] = 1;
+      order.push_back(b);
+      const Block &block = func.blocks[b];
+      if (block.term == Block::RET)
+        break;
+      int32_t likely = block.succ[block.term == Block::BR ? 1 : 0];
+      if (block.term == Block::BR) {
+        pending.push_back(block.succ[0]);
+        if (placed[likely])
+          likely = block.succ[0];
+      }
+      b = likely;
+    }
+  }
+  std::vector<int32_t> index(n);
+  for (size_t i = 0; i < n; ++i)
+    index[order[i]] = static_cast<int32_t>(i);
+  std::vector<Block> blocks(n);
+  for (size_t i = 0; i < n; ++i) {
+    blocks[i] = std::move(func.blocks[order[i]]);
+    for (int32_t k = 0; k < blocks[i].succ_count(); ++k)
+      blocks[i].succ[k] = index[blocks[i].succ[k]];
+  }
+  func.blocks = std::move(blocks);
+  func.compute_preds();
+
+  // a condition computed right before its branch may be inverted if that
+  // is the only kind of use its temporary has, duplicated tests included
+  auto local = [](const Block &block) {
+    return block.term == Block::BR && !block.insts.empty() &&
+           block.insts.back().dst == block.cond;
+  };
+  std::vector<int32_t> uses(func.ntemps);
+  for (auto &block : func.blocks) {
+    for (auto &inst : block.insts)
+      for_uses(inst, [&](Operand &opd) { ++uses[opd.val]; });
+    if (block.cond.is_temp() && !local(block))
+      ++uses[block.cond.val];
+  }
+  for (size_t i = 0; i + 1 < n; ++i) {
+    Block &block = func.blocks[i];
+    if (!local(block) || block.succ[0] != static_cast<int32_t>(i + 1) ||
+        block.succ[1] == static_cast<int32_t>(i + 1))
+      continue;
+    Inst &last = block.insts.back();
+    if (last.op == Op::BIN && invert(last.sub) && !uses[block.cond.val]) {
+      last.sub = invert(last.sub);
+      std::swap(block.succ[0], block.succ[1]);
+    }
+  }
+}
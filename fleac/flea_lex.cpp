@@ -0,0 +1,275 @@
+#include "flea_lex.hpp"
+#include "flea_ast.hpp"
+#include "flea.tab.hpp"
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void yyerror(const char *msg, int yylineno);
+
+int yylineno = 1;
+// the rest of the source still to scan
+static const char *cur = nullptr, *src_end = nullptr;
+
+#ifdef _WIN32
+MappedFile::MappedFile(const char *path) {
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return;
+  LARGE_INTEGER size;
+  if (GetFileSizeEx(file, &size)) {
+    opened = true, length = static_cast<size_t>(size.QuadPart);
+    HANDLE mapping = length ? CreateFileMappingA(file, nullptr, PAGE_READONLY,
+                                                 0, 0, nullptr)
+                            : nullptr;
+    if (mapping) {
+      begin = static_cast<const char *>(
+          MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+      CloseHandle(mapping);
+    }
+    if (length && !begin)
+      opened = false, length = 0;
+  }
+  CloseHandle(file);
+}
+
+MappedFile::~MappedFile() {
+  if (begin)
+    UnmapViewOfFile(begin);
+}
+#else
+MappedFile::MappedFile(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (!fstat(fd, &st)) {
+    opened = true, length = static_cast<size_t>(st.st_size);
+    // an empty file cannot be mapped, and needs not be
+    if (length) {
+      void *map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map == MAP_FAILED)
+        opened = false, length = 0;
+      else
+        begin = static_cast<const char *>(map);
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (begin)
+    munmap(const_cast<char *>(begin), length);
+}
+#endif
+
+void lex_init(const char *begin, const char *end) {
+  cur = begin, src_end = end, yylineno = 1;
+}
+
+static bool is_ident(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+#ifdef __SSE2__
+// Bit i is set where byte i of v lies in [lo, hi].
+static inline unsigned in_range(__m128i v, char lo, char hi) {
+  __m128i above = _mm_cmpgt_epi8(v, _mm_set1_epi8(static_cast<char>(lo - 1)));
+  __m128i below = _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(hi + 1)));
+  return static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(above, below)));
+}
+
+static inline unsigned equal(__m128i v, char c) {
+  return static_cast<unsigned>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c))));
+}
+
+static inline __m128i load(const char *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+#endif
+
+// The scanners below take 16 bytes at a time while that many are left and
+// finish byte by byte.
+
+static const char *skip_ident(const char *p) {
+#ifdef __SSE2__
+  for (; src_end - p >= 16; p += 16) {
+    __m128i v = load(p);
+    unsigned lower = in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    unsigned mask = lower | in_range(v, '0', '9') | equal(v, '_');
+    if (mask != 0xffff)
+      return p + __builtin_ctz(~mask);
+  }
+#endif
+  while (p < src_end && is_ident(*p))
+    ++p;
+  return p;
+}
+
+static const char *skip_space(const char *p) {
+#ifdef __SSE2__
+  for (; src_end - p >= 16; p += 16) {
+    __m128i v = load(p);
+    unsigned newline = equal(v, '\n');
+    unsigned mask = equal(v, ' ') | equal(v, '\t') | equal(v, '\r') | newline;
+    if (mask != 0xffff) {
+      int n = __builtin_ctz(~mask);
+      yylineno += __builtin_popcount(newline & ((1u << n) - 1));
+      return p + n;
+    }
+    yylineno += __builtin_popcount(newline);
+  }
+#endif
+  for (; p < src_end && is_space(*p); ++p)
+    yylineno += *p == '\n';
+  return p;
+}
+
+// Returns the newline ending a line comment, or src_end.
+static const char *skip_line(const char *p) {
+#ifdef __SSE2__
+  for (; src_end - p >= 16; p += 16)
+    if (unsigned newline = equal(load(p), '\n'))
+      return p + __builtin_ctz(newline);
+#endif
+  auto nl = static_cast<const char *>(
+      memchr(p, '\n', static_cast<size_t>(src_end - p)));
+  return nl ? nl : src_end;
+}
+
+// Returns the character after the "*/" closing a block comment, or null.
+static const char *skip_block(const char *p) {
+#ifdef __SSE2__
+  for (; src_end - p >= 17; p += 16) {
+    __m128i v = load(p);
+    unsigned star = equal(v, '*') & equal(load(p + 1), '/');
+    unsigned newline = equal(v, '\n');
+    if (star) {
+      int n = __builtin_ctz(star);
+      yylineno += __builtin_popcount(newline & ((1u << n) - 1));
+      return p + n + 2;
+    }
+    yylineno += __builtin_popcount(newline);
+  }
+#endif
+  for (; src_end - p >= 2; ++p) {
+    if (p[0] == '*' && p[1] == '/')
+      return p + 2;
+    yylineno += *p == '\n';
+  }
+  yylineno += p < src_end && *p == '\n';
+  return nullptr;
+}
+
+// Keywords by (first * 5 + last + length) % 16, which tells them all apart.
+static int keyword(const char *p, size_t n) {
+  struct Keyword {
+    std::string_view name;
+    int token;
+  };
+  static const Keyword table[16] = {{},
+                                     {},
+                                     {"else", ELSE},
+                                     {},
+                                     {"int", INT},
+                                     {"if", IF},
+                                     {"void", VOID},
+                                     {},
+                                     {"const", CONST},
+                                     {},
+                                     {"break", BREAK},
+                                     {},
+                                     {"continue", CONTINUE},
+                                     {"while", WHILE},
+                                     {"return", RETURN},
+                                     {}};
+  auto h = static_cast<size_t>(static_cast<unsigned char>(p[0]) * 5 +
+                               static_cast<unsigned char>(p[n - 1]) + n) & 15;
+  const Keyword &kw = table[h];
+  return kw.name == std::string_view(p, n) ? kw.token : 0;
+}
+
+// Literals wrap around to 32 bits, as they did through strtol.
+static int32_t number(const char *&p) {
+  uint32_t val = 0;
+  if (*p != '0') {
+    for (; p < src_end && *p >= '0' && *p <= '9'; ++p)
+      val = val * 10 + static_cast<uint32_t>(*p - '0');
+  } else if (src_end - p > 2 && (p[1] == 'x' || p[1] == 'X') &&
+             isxdigit(static_cast<unsigned char>(p[2]))) {
+    for (p += 2; p < src_end && isxdigit(static_cast<unsigned char>(*p)); ++p) {
+      uint32_t digit = static_cast<uint32_t>(*p <= '9' ? *p - '0'
+                                                       : (*p | 0x20) - 'a' + 10);
+      val = val * 16 + digit;
+    }
+  } else
+    for (++p; p < src_end && *p >= '0' && *p <= '7'; ++p)
+      val = val * 8 + static_cast<uint32_t>(*p - '0');
+  return static_cast<int32_t>(val);
+}
+
+int yylex() {
+  for (;;) {
+    cur = skip_space(cur);
+    if (cur == src_end)
+      return 0;
+    if (*cur != '/' || src_end - cur < 2)
+      break;
+    if (cur[1] == '/')
+      cur = skip_line(cur + 2);
+    else if (cur[1] == '*') {
+      if (!(cur = skip_block(cur + 2))) {
+        yyerror("Unclosed block comment", yylineno);
+        exit(1);
+      }
+    } else
+      break;
+  }
+  const char *start = cur;
+  char c = *cur;
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+    cur = skip_ident(cur + 1);
+    auto n = static_cast<size_t>(cur - start);
+    if (int token = keyword(start, n))
+      return token;
+    yylval.ident_val = Ident::intern(std::string_view(start, n));
+    return IDENT;
+  }
+  if (c >= '0' && c <= '9') {
+    yylval.int_val = number(cur);
+    return INT_CONST;
+  }
+  ++cur;
+  if (cur < src_end && *cur == '=') {
+    int token = c == '<' ? LE : c == '>' ? GE : c == '=' ? EQ : c == '!' ? NE : 0;
+    if (token)
+      return ++cur, token;
+  }
+  if (c == '<')
+    return LT;
+  if (c == '>')
+    return GT;
+  return static_cast<unsigned char>(c);
+}
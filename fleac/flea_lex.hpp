@@ -0,0 +1,29 @@
+#ifndef FLEA_LEX_HPP_FLAG
+#define FLEA_LEX_HPP_FLAG
+
+#include <cstddef>
+
+// A source file mapped read-only into memory; empty if it could not be.
+class MappedFile {
+public:
+  explicit MappedFile(const char *path);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+  bool ok() const { return opened; }
+  const char *data() const { return begin; }
+  size_t size() const { return length; }
+
+private:
+  bool opened = false;
+  const char *begin = nullptr;
+  size_t length = 0;
+};
+
+// Points yylex at the source in [begin, end), which must outlive the parse;
+// the line count starts over at 1.
+void lex_init(const char *begin, const char *end);
+int yylex();
+extern int yylineno;
+
+#endif // FLEA_LEX_HPP_FLAG
@@ -0,0 +1,466 @@
+#include "flea_opt.hpp"
+#include <algorithm>
+#include <map>
+
+// Code-size budget, in IR instructions: the most one unrolled loop body
+// may grow to, and the most all loop transformations may add to a function.
+constexpr int32_t unroll_budget = 64;
+constexpr int32_t growth_budget = 256;
+// Trip counts are found by running the exit test at compile time.
+constexpr int32_t max_trip_count = 1 << 16;
+
+// A natural loop: the blocks that reach a back edge to header without
+// passing through it, innermost loops being the smaller ones.
+struct Loop {
+  int32_t header, pre = -1;
+  std::vector<int32_t> blocks, latches;
+  std::vector<char> in;
+  bool contains(int32_t b) const {
+    return b >= 0 && b < static_cast<int32_t>(in.size()) && in[b];
+  }
+};
+
+static std::vector<Loop> find_loops(Function &func) {
+  func.compute_preds();
+  std::vector<int32_t> idom = func.idom();
+  auto dominates = [&](int32_t a, int32_t b) {
+    for (; b != a && b != 0 && idom[b] != -1; b = idom[b])
+      ;
+    return a == b;
+  };
+  std::map<int32_t, Loop> loops;
+  for (int32_t b = 0; b < static_cast<int32_t>(func.blocks.size()); ++b) {
+    const Block &block = func.blocks[b];
+    for (int32_t k = 0; k < block.succ_count(); ++k)
+      if (idom[b] != -1 && dominates(block.succ[k], b)) {
+        Loop &loop = loops[block.succ[k]];
+        loop.header = block.succ[k];
+        loop.latches.push_back(b);
+      }
+  }
+  std::vector<Loop> result;
+  for (auto &[header, loop] : loops) {
+    loop.in.assign(func.blocks.size(), 0);
+    loop.in[header] = 1;
+    std::vector<int32_t> work = loop.latches;
+    while (!work.empty()) {
+      int32_t b = work.back();
+      work.pop_back();
+      if (loop.in[b])
+        continue;
+      loop.in[b] = 1;
+      for (int32_t pred : func.blocks[b].preds)
+        work.push_back(pred);
+    }
+    for (int32_t b = 0; b < static_cast<int32_t>(func.blocks.size()); ++b)
+      if (loop.in[b])
+        loop.blocks.push_back(b);
+    result.push_back(std::move(loop));
+  }
+  std::stable_sort(result.begin(), result.end(),
+                   [](const Loop &x, const Loop &y) {
+                     return x.blocks.size() < y.blocks.size();
+                   });
+  return result;
+}
+
+// Gives the loop a preheader: a block outside it that jumps to the header
+// and is the header's only predecessor from outside.
+static void make_preheader(Function &func, Loop &loop) {
+  std::vector<int32_t> outside;
+  for (int32_t pred : func.blocks[loop.header].preds)
+    if (!loop.contains(pred) &&
+        std::find(outside.begin(), outside.end(), pred) == outside.end())
+      outside.push_back(pred);
+  if (outside.empty())
+    return;
+  if (outside.size() == 1 && func.blocks[outside[0]].term == Block::JMP) {
+    loop.pre = outside[0];
+    return;
+  }
+  int32_t pre = func.new_block();
+  Block &block = func.blocks[pre];
+  block.term = Block::JMP, block.succ[0] = loop.header;
+  for (int32_t b : outside)
+    for (int32_t k = 0; k < func.blocks[b].succ_count(); ++k)
+      if (func.blocks[b].succ[k] == loop.header)
+        func.blocks[b].succ[k] = pre;
+  for (auto &phi : func.blocks[loop.header].insts) {
+    if (phi.op != Op::PHI)
+      break;
+    Inst merged(Op::PHI, Operand::temp(func.new_temp()));
+    std::vector<Operand> args;
+    std::vector<int32_t> from;
+    for (size_t i = 0; i < phi.from.size(); ++i)
+      if (loop.contains(phi.from[i]))
+        args.push_back(phi.args[i]), from.push_back(phi.from[i]);
+      else
+        merged.args.push_back(phi.args[i]), merged.from.push_back(phi.from[i]);
+    args.push_back(merged.args.size() == 1 ? merged.args[0] : merged.dst);
+    from.push_back(pre);
+    if (merged.args.size() > 1)
+      func.blocks[pre].insts.push_back(std::move(merged));
+    phi.args = std::move(args), phi.from = std::move(from);
+  }
+  loop.pre = pre;
+  func.compute_preds();
+}
+
+// Moves the pure computations of the loop whose operands are all defined
+// outside it, or are globals it never writes, to the preheader. Loads stay,
+// as the loop may store to any array.
+static void hoist_invariants(Function &func, const Loop &loop) {
+  std::vector<int32_t> def_block(func.ntemps, -1);
+  bool has_call = false;
+  std::vector<int32_t> stored;
+  for (size_t b = 0; b < func.blocks.size(); ++b)
+    for (const auto &inst : func.blocks[b].insts) {
+      if (inst.dst.is_temp())
+        def_block[inst.dst.val] = static_cast<int32_t>(b);
+      if (!loop.contains(static_cast<int32_t>(b)))
+        continue;
+      has_call |= inst.op == Op::CALL;
+      if (inst.dst.kind == Operand::MEM)
+        stored.push_back(inst.dst.val);
+    }
+  auto invariant = [&](const Operand &opd) {
+    switch (opd.kind) {
+    case Operand::TEMP:
+      return !loop.contains(def_block[opd.val]);
+    case Operand::MEM:
+      return !has_call &&
+             std::find(stored.begin(), stored.end(), opd.val) == stored.end();
+    default:
+      return true;
+    }
+  };
+  auto &pre = func.blocks[loop.pre].insts;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int32_t b : loop.blocks) {
+      auto &insts = func.blocks[b].insts;
+      for (size_t i = 0; i < insts.size();) {
+        const Inst &inst = insts[i];
+        if ((inst.op != Op::BIN && inst.op != Op::UN && inst.op != Op::FRAME) ||
+            !inst.dst.is_temp() || may_trap(inst) || !invariant(inst.a) ||
+            !invariant(inst.b)) {
+          ++i;
+          continue;
+        }
+        def_block[inst.dst.val] = loop.pre;
+        pre.push_back(inst);
+        insts.erase(insts.begin() + static_cast<std::ptrdiff_t>(i));
+        changed = true;
+      }
+    }
+  }
+}
+
+// A basic induction variable: a header phi i = phi(init, i + step).
+struct Induction {
+  Inst *phi;
+  Operand init;
+  int32_t step, latch, next;
+};
+
+static std::vector<Induction> find_inductions(Function &func,
+                                              const Loop &loop) {
+  std::vector<Induction> ivs;
+  if (loop.latches.size() != 1)
+    return ivs;
+  int32_t latch = loop.latches[0];
+  std::map<int32_t, Inst *> def;
+  for (int32_t b : loop.blocks)
+    for (auto &inst : func.blocks[b].insts)
+      if (inst.dst.is_temp())
+        def[inst.dst.val] = &inst;
+  for (auto &phi : func.blocks[loop.header].insts) {
+    if (phi.op != Op::PHI)
+      break;
+    if (phi.from.size() != 2)
+      continue;
+    size_t back = phi.from[0] == latch ? 0 : 1;
+    if (phi.from[back] != latch || phi.from[1 - back] != loop.pre ||
+        !phi.args[back].is_temp())
+      continue;
+    auto it = def.find(phi.args[back].val);
+    if (it == def.end() || it->second->op != Op::BIN ||
+        it->second->sub != '+' || it->second->a != phi.dst ||
+        !it->second->b.is_imm())
+      continue;
+    ivs.push_back({&phi, phi.args[1 - back], it->second->b.val, latch,
+                   phi.args[back].val});
+  }
+  return ivs;
+}
+
+// Replaces each i * k of a basic induction variable i by a new induction
+// variable that starts at init * k and advances by step * k.
+static int32_t reduce_strength(Function &func, const Loop &loop) {
+  struct Candidate {
+    int32_t block;
+    size_t index;
+    size_t iv;
+  };
+  std::vector<Induction> ivs = find_inductions(func, loop);
+  std::vector<Candidate> found;
+  for (int32_t b : loop.blocks) {
+    auto &insts = func.blocks[b].insts;
+    for (size_t i = 0; i < insts.size(); ++i) {
+      const Inst &inst = insts[i];
+      if (inst.op != Op::BIN || inst.sub != '*' || !inst.b.is_imm())
+        continue;
+      for (size_t v = 0; v < ivs.size(); ++v)
+        if (inst.a == ivs[v].phi->dst)
+          found.push_back({b, i, v});
+    }
+  }
+  // new phis and increments are only added once all positions are known
+  struct Reduced {
+    Operand init;
+    int32_t step, next_of, latch;
+    Operand dst, next;
+  };
+  std::map<std::pair<size_t, int32_t>, Operand> made;
+  std::vector<Reduced> added;
+  for (const auto &c : found) {
+    Inst &inst = func.blocks[c.block].insts[c.index];
+    const Induction &iv = ivs[c.iv];
+    int32_t k = inst.b.val;
+    auto [it, fresh] = made.try_emplace({c.iv, k});
+    if (fresh) {
+      Reduced r{iv.init, 0, iv.next, iv.latch, {}, {}};
+      fold('*', false, iv.step, k, r.step);
+      if (iv.init.is_imm()) {
+        fold('*', false, iv.init.val, k, r.init.val);
+      } else {
+        r.init = Operand::temp(func.new_temp());
+        func.blocks[loop.pre].insts.emplace_back(Op::BIN, r.init, iv.init,
+                                                 Operand::imm(k), '*');
+      }
+      r.dst = Operand::temp(func.new_temp());
+      r.next = Operand::temp(func.new_temp());
+      it->second = r.dst;
+      added.push_back(r);
+    }
+    inst = Inst(Op::MOV, inst.dst, it->second);
+  }
+  for (const auto &r : added) {
+    Inst phi(Op::PHI, r.dst);
+    phi.args = {r.init, r.next};
+    phi.from = {loop.pre, r.latch};
+    auto &header = func.blocks[loop.header].insts;
+    header.insert(header.begin(), std::move(phi));
+    for (int32_t b : loop.blocks) {
+      auto &insts = func.blocks[b].insts;
+      auto pos = std::find_if(insts.begin(), insts.end(), [&](const Inst &i) {
+        return i.dst == Operand::temp(r.next_of);
+      });
+      if (pos != insts.end()) {
+        insts.insert(pos + 1, Inst(Op::BIN, r.next, r.dst,
+                                   Operand::imm(r.step), '+'));
+        break;
+      }
+    }
+  }
+  return static_cast<int32_t>(2 * added.size());
+}
+
+// The number of times the body of a loop runs if its header exits on a
+// comparison of a basic induction variable with constants, else -1.
+static int32_t trip_count(Function &func, const Loop &loop) {
+  const Block &header = func.blocks[loop.header];
+  if (header.term != Block::BR || !header.cond.is_temp() ||
+      header.insts.empty() || header.insts.back().dst != header.cond)
+    return -1;
+  const Inst &cmp = header.insts.back();
+  for (const auto &iv : find_inductions(func, loop)) {
+    if (cmp.op != Op::BIN || cmp.a != iv.phi->dst || !cmp.b.is_imm() ||
+        !iv.init.is_imm())
+      continue;
+    int32_t val = iv.init.val, result;
+    for (int32_t count = 0; count < max_trip_count; ++count) {
+      if (!fold(cmp.sub, false, val, cmp.b.val, result))
+        return -1;
+      if (!loop.contains(header.succ[result ? 0 : 1]))
+        return count;
+      fold('+', false, val, iv.step, val);
+    }
+    return -1;
+  }
+  return -1;
+}
+
+// Once the body is copied as many times as it runs, the exit test after it
+// always leaves: the body then jumps straight to the exit, and phis there
+// give the outside the values the header phis would have had.
+static void drop_back_edge(Function &func, const Loop &loop, int32_t body) {
+  Block &header = func.blocks[loop.header];
+  int32_t exit = header.succ[0] == body ? header.succ[1] : header.succ[0];
+  if (func.blocks[exit].preds.size() != 1)
+    return;
+  std::vector<char> in_header(func.ntemps);
+  std::map<int32_t, Operand> last;
+  for (const auto &inst : header.insts) {
+    if (inst.op == Op::PHI) {
+      last[inst.dst.val] = inst.args[inst.from[0] == body ? 0 : 1];
+      continue;
+    }
+    if (inst.has_side_effect())
+      return;
+    if (inst.dst.is_temp())
+      in_header[inst.dst.val] = 1;
+  }
+  bool escapes = false;
+  std::vector<char> used(func.ntemps);
+  for (size_t b = 0; b < func.blocks.size(); ++b) {
+    if (loop.contains(static_cast<int32_t>(b)))
+      continue;
+    auto use = [&](Operand &opd) {
+      escapes |= in_header[opd.val] != 0;
+      used[opd.val] = 1;
+    };
+    for (auto &inst : func.blocks[b].insts)
+      for_uses(inst, use);
+    if (func.blocks[b].cond.is_temp())
+      use(func.blocks[b].cond);
+  }
+  for (const auto &[t, val] : last)
+    escapes |= val.is_temp() && in_header[val.val];
+  if (escapes)
+    return;
+
+  std::vector<Operand> repl(func.ntemps);
+  std::vector<Inst> phis;
+  for (const auto &[t, val] : last) {
+    if (!used[t])
+      continue;
+    Inst phi(Op::PHI, Operand::temp(func.new_temp()));
+    phi.args = {Operand::temp(t), val};
+    phi.from = {loop.header, body};
+    repl.resize(func.ntemps);
+    repl[t] = phi.dst;
+    phis.push_back(std::move(phi));
+  }
+  for (size_t b = 0; b < func.blocks.size(); ++b) {
+    if (loop.contains(static_cast<int32_t>(b)))
+      continue;
+    for (auto &inst : func.blocks[b].insts)
+      for_uses(inst, [&](Operand &opd) {
+        if (repl[opd.val].kind != Operand::NONE)
+          opd = repl[opd.val];
+      });
+    Operand &cond = func.blocks[b].cond;
+    if (cond.is_temp() && repl[cond.val].kind != Operand::NONE)
+      cond = repl[cond.val];
+  }
+  auto &insts = func.blocks[exit].insts;
+  insts.insert(insts.begin(), phis.begin(), phis.end());
+  for (auto &phi : header.insts) {
+    if (phi.op != Op::PHI)
+      break;
+    size_t back = phi.from[0] == body ? 0 : 1;
+    phi.args.erase(phi.args.begin() + static_cast<std::ptrdiff_t>(back));
+    phi.from.erase(phi.from.begin() + static_cast<std::ptrdiff_t>(back));
+  }
+  func.blocks[body].succ[0] = exit;
+  func.compute_preds();
+}
+
+// Unrolls a loop made of its header and one body block by a factor that
+// divides the trip count: the body is followed by copies of the header and
+// body, whose exit tests are known not to leave the loop.
+static int32_t unroll(Function &func, const Loop &loop, int32_t budget) {
+  if (loop.blocks.size() != 2 || loop.latches.size() != 1)
+    return 0;
+  int32_t body = loop.latches[0];
+  const Block &header = func.blocks[loop.header];
+  if (func.blocks[body].term != Block::JMP || header.term != Block::BR)
+    return 0;
+  int32_t trips = trip_count(func, loop);
+  auto phis = static_cast<int32_t>(
+      std::count_if(header.insts.begin(), header.insts.end(),
+                    [](const Inst &i) { return i.op == Op::PHI; }));
+  int32_t size = static_cast<int32_t>(header.insts.size()) - phis +
+                 static_cast<int32_t>(func.blocks[body].insts.size());
+  int32_t factor = 0;
+  for (int32_t u : {trips, 8, 4, 2})
+    if (u >= 2 && u <= 16 && trips >= u && trips % u == 0 &&
+        u * size <= unroll_budget && (u - 1) * size <= budget) {
+      factor = u;
+      break;
+    }
+  if (!factor)
+    return 0;
+
+  std::map<int32_t, Operand> prev, cur;
+  auto subst = [](const std::map<int32_t, Operand> &map, Operand opd) {
+    if (!opd.is_temp())
+      return opd;
+    auto it = map.find(opd.val);
+    return it == map.end() ? opd : it->second;
+  };
+  std::vector<Inst> insts = func.blocks[body].insts;
+  for (int32_t copy = 1; copy < factor; ++copy) {
+    cur.clear();
+    for (const auto &phi : func.blocks[loop.header].insts) {
+      if (phi.op != Op::PHI)
+        break;
+      size_t back = phi.from[0] == body ? 0 : 1;
+      cur[phi.dst.val] = subst(prev, phi.args[back]);
+    }
+    auto clone = [&](const Inst &orig) {
+      Inst inst = orig;
+      for_uses(inst, [&](Operand &opd) { opd = subst(cur, opd); });
+      if (inst.dst.is_temp()) {
+        Operand fresh = Operand::temp(func.new_temp());
+        cur[inst.dst.val] = fresh, inst.dst = fresh;
+      }
+      insts.push_back(std::move(inst));
+    };
+    for (const auto &inst : func.blocks[loop.header].insts)
+      if (inst.op != Op::PHI)
+        clone(inst);
+    for (const auto &inst : func.blocks[body].insts)
+      clone(inst);
+    prev = std::move(cur);
+  }
+  for (auto &phi : func.blocks[loop.header].insts) {
+    if (phi.op != Op::PHI)
+      break;
+    size_t back = phi.from[0] == body ? 0 : 1;
+    phi.args[back] = subst(prev, phi.args[back]);
+  }
+  func.blocks[body].insts = std::move(insts);
+  if (factor == trips)
+    drop_back_edge(func, loop, body);
+  return (factor - 1) * size;
+}
+
+// Finds the natural loops, innermost first, gives each a preheader, hoists
+// its invariants, reduces multiplications of its induction variables and
+// unrolls it if its trip count is known and it is small enough.
+void optimize_loops(Function &func) {
+  func.remove_unreachable();
+  std::vector<int32_t> done;
+  int32_t budget = growth_budget;
+  for (;;) {
+    std::vector<Loop> loops = find_loops(func);
+    auto it = std::find_if(loops.begin(), loops.end(), [&](const Loop &l) {
+      return std::find(done.begin(), done.end(), l.header) == done.end();
+    });
+    if (it == loops.end())
+      break;
+    Loop &loop = *it;
+    done.push_back(loop.header);
+    make_preheader(func, loop);
+    if (loop.pre == -1)
+      continue;
+    hoist_invariants(func, loop);
+    if (budget > 0)
+      budget -= reduce_strength(func, loop);
+    if (budget > 0)
+      budget -= unroll(func, loop, budget);
+  }
+  func.compute_preds();
+}
@@ -0,0 +1,555 @@
+#include "flea_opt.hpp"
+#include "flea_expr.hpp"
+#include "flea_report.hpp"
+#include <algorithm>
+#include <array>
+#include <map>
+#include <tuple>
+
+bool fold(char op, bool unary, int32_t a, int32_t b, int32_t &result) {
+  if (unary) {
+    result = op == '-' ? safe_sub(0, a) : !a;
+    return true;
+  }
+  switch (op) {
+  case '+':
+    result = safe_add(a, b);
+    return true;
+  case '-':
+    result = safe_sub(a, b);
+    return true;
+  case '*':
+    result = safe_mul(a, b);
+    return true;
+  case '/':
+  case '%':
+    // the VM traps on these, so they are left for run time
+    if (b == 0 || (a == INT32_MIN && b == -1))
+      return false;
+    result = op == '/' ? floor_div(a, b) : floor_mod(a, b);
+    return true;
+  case '<':
+    result = a < b;
+    return true;
+  case '>':
+    result = a > b;
+    return true;
+  case 'l':
+    result = a <= b;
+    return true;
+  case 'g':
+    result = a >= b;
+    return true;
+  case 'e':
+    result = a == b;
+    return true;
+  case 'n':
+    result = a != b;
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool is_commutative(char op) {
+  return op == '+' || op == '*' || op == 'e' || op == 'n';
+}
+
+char mirror(char op) {
+  switch (op) {
+  case '<':
+    return '>';
+  case '>':
+    return '<';
+  case 'l':
+    return 'g';
+  case 'g':
+    return 'l';
+  default:
+    return op;
+  }
+}
+
+char invert(char op) {
+  switch (op) {
+  case '<':
+    return 'g';
+  case 'g':
+    return '<';
+  case '>':
+    return 'l';
+  case 'l':
+    return '>';
+  case 'e':
+    return 'n';
+  case 'n':
+    return 'e';
+  default:
+    return 0;
+  }
+}
+
+bool may_trap(const Inst &inst) {
+  return inst.op == Op::BIN && (inst.sub == '/' || inst.sub == '%') &&
+         !(inst.b.is_imm() && inst.b.val != 0 && inst.b.val != -1);
+}
+
+// Rewrites every use of a temporary t to repl[t] when one is set.
+static void replace_uses(Function &func, const std::vector<Operand> &repl) {
+  auto find = [&](Operand opd) {
+    while (opd.is_temp() && repl[opd.val].kind != Operand::NONE)
+      opd = repl[opd.val];
+    return opd;
+  };
+  for (auto &block : func.blocks) {
+    for (auto &inst : block.insts)
+      for_uses(inst, [&](Operand &opd) { opd = find(opd); });
+    if (block.cond.is_temp())
+      block.cond = find(block.cond);
+  }
+}
+
+// Maps every temporary to the instruction that defines it.
+static std::vector<Inst *> def_map(Function &func) {
+  std::vector<Inst *> def(func.ntemps);
+  for (auto &block : func.blocks)
+    for (auto &inst : block.insts)
+      if (inst.dst.is_temp())
+        def[inst.dst.val] = &inst;
+  return def;
+}
+
+// Sparse conditional constant propagation after Wegman and Zadeck, iterated
+// over the blocks in reverse postorder until the lattice settles.
+void sccp(Function &func) {
+  enum State : char { TOP, CONST, BOTTOM };
+  struct Cell {
+    State state = TOP;
+    int32_t val = 0;
+  };
+  auto n = func.blocks.size();
+  std::vector<Cell> cells(func.ntemps);
+  for (int32_t i = 0; i < func.nparams; ++i)
+    cells[i].state = BOTTOM;
+  std::vector<std::array<char, 2>> edge(n, {0, 0});
+  std::vector<char> reached(n);
+  reached[0] = 1;
+  auto value = [&](const Operand &opd) {
+    if (opd.is_imm())
+      return Cell{CONST, opd.val};
+    if (opd.is_temp())
+      return cells[opd.val];
+    return Cell{BOTTOM, 0};
+  };
+  auto meet = [](Cell x, Cell y) {
+    if (x.state == TOP)
+      return y;
+    if (y.state == TOP || (x.state == CONST && y.state == CONST &&
+                           x.val == y.val))
+      return x;
+    return Cell{BOTTOM, 0};
+  };
+  auto executable = [&](int32_t from, int32_t to) {
+    const Block &block = func.blocks[from];
+    for (int32_t k = 0; k < block.succ_count(); ++k)
+      if (block.succ[k] == to && edge[from][k])
+        return true;
+    return false;
+  };
+  std::vector<int32_t> order = func.rpo();
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int32_t b : order) {
+      if (!reached[b])
+        continue;
+      Block &block = func.blocks[b];
+      for (auto &inst : block.insts) {
+        if (!inst.dst.is_temp())
+          continue;
+        Cell cell{BOTTOM, 0};
+        switch (inst.op) {
+        case Op::MOV:
+          cell = value(inst.a);
+          break;
+        case Op::BIN:
+        case Op::UN: {
+          Cell x = value(inst.a), y = inst.op == Op::BIN ? value(inst.b)
+                                                         : Cell{CONST, 0};
+          if (x.state == BOTTOM || y.state == BOTTOM)
+            break;
+          if (x.state == TOP || y.state == TOP)
+            cell.state = TOP;
+          else if (fold(inst.sub, inst.op == Op::UN, x.val, y.val, cell.val))
+            cell.state = CONST;
+          break;
+        }
+        case Op::PHI:
+          cell.state = TOP;
+          for (size_t i = 0; i < inst.args.size(); ++i)
+            if (executable(inst.from[i], b))
+              cell = meet(cell, value(inst.args[i]));
+          break;
+        default:
+          break;
+        }
+        Cell &old = cells[inst.dst.val];
+        cell = meet(old, cell);
+        if (cell.state != old.state || cell.val != old.val)
+          old = cell, changed = true;
+      }
+      auto mark = [&](int32_t k) {
+        if (!edge[b][k])
+          edge[b][k] = 1, reached[block.succ[k]] = 1, changed = true;
+      };
+      if (block.term == Block::JMP)
+        mark(0);
+      else if (block.term == Block::BR) {
+        Cell cond = value(block.cond);
+        if (cond.state == CONST)
+          mark(cond.val ? 0 : 1);
+        else if (cond.state == BOTTOM)
+          mark(0), mark(1);
+      }
+    }
+  }
+
+  std::vector<Operand> repl(func.ntemps);
+  for (int32_t t = 0; t < func.ntemps; ++t)
+    if (cells[t].state == CONST)
+      repl[t] = Operand::imm(cells[t].val);
+  replace_uses(func, repl);
+  for (size_t b = 0; b < n; ++b) {
+    Block &block = func.blocks[b];
+    if (!reached[b]) {
+      block.term = Block::RET, block.cond = Operand();
+      continue;
+    }
+    if (block.term == Block::BR && block.cond.is_imm()) {
+      block.term = Block::JMP;
+      block.succ[0] = block.succ[block.cond.val ? 0 : 1];
+      block.cond = Operand();
+    }
+    std::erase_if(block.insts, [&](const Inst &inst) {
+      return inst.dst.is_temp() && cells[inst.dst.val].state == CONST &&
+             !inst.has_side_effect() && !may_trap(inst);
+    });
+  }
+  func.remove_unreachable();
+}
+
+// Folds constants, applies algebraic identities, canonicalizes immediates to
+// the right, reassociates chains of additions and multiplications by
+// constants, and absorbs negations into comparisons and branches.
+void simplify(Function &func) {
+  std::vector<Inst *> def = def_map(func);
+  // operands of the returned definition may be reused at its uses, so one
+  // that reads a global, which might have been stored to since, is skipped
+  auto def_of = [&](const Operand &opd, Op op) -> Inst * {
+    if (!opd.is_temp() || !def[opd.val] || def[opd.val]->op != op)
+      return nullptr;
+    Inst *src = def[opd.val];
+    if (src->a.kind == Operand::MEM || src->b.kind == Operand::MEM)
+      return nullptr;
+    return src;
+  };
+  auto to_mov = [](Inst &inst, Operand val) {
+    inst = Inst(Op::MOV, inst.dst, val);
+  };
+  for (auto &block : func.blocks) {
+    for (auto &inst : block.insts) {
+      int32_t result;
+      if (inst.op == Op::UN) {
+        if (inst.a.is_imm() && fold(inst.sub, true, inst.a.val, 0, result)) {
+          to_mov(inst, Operand::imm(result));
+          continue;
+        }
+        Inst *src = def_of(inst.a, inst.sub == '!' ? Op::BIN : Op::UN);
+        if (inst.sub == '!' && src && invert(src->sub))
+          inst = Inst(Op::BIN, inst.dst, src->a, src->b, invert(src->sub));
+        else if (inst.sub == '-' && src && src->sub == '-')
+          to_mov(inst, src->a);
+        continue;
+      }
+      if (inst.op != Op::BIN)
+        continue;
+      Operand &a = inst.a, &b = inst.b;
+      if (a.is_imm() && b.is_imm()) {
+        if (fold(inst.sub, false, a.val, b.val, result))
+          to_mov(inst, Operand::imm(result));
+        continue;
+      }
+      if (a.is_imm() && (is_commutative(inst.sub) || invert(inst.sub)))
+        std::swap(a, b), inst.sub = mirror(inst.sub);
+      if (inst.sub == '-' && b.is_imm())
+        inst.sub = '+', b.val = safe_sub(0, b.val);
+      if (a == b && a.is_temp()) {
+        if (inst.sub == '-' || inst.sub == 'n' || inst.sub == '<' ||
+            inst.sub == '>')
+          to_mov(inst, Operand::imm(0));
+        else if (inst.sub == 'e' || inst.sub == 'l' || inst.sub == 'g')
+          to_mov(inst, Operand::imm(1));
+        continue;
+      }
+      if (!b.is_imm())
+        continue;
+      if (Inst *src = def_of(a, Op::BIN);
+          src && src->sub == inst.sub && src->b.is_imm() &&
+          (inst.sub == '+' || inst.sub == '*')) {
+        fold(inst.sub, false, src->b.val, b.val, b.val);
+        a = src->a;
+      }
+      if ((inst.sub == '+' && b.val == 0) ||
+          ((inst.sub == '*' || inst.sub == '/') && b.val == 1))
+        to_mov(inst, a);
+      else if ((inst.sub == '*' && b.val == 0) ||
+               (inst.sub == '%' && (b.val == 1 || b.val == -1)))
+        to_mov(inst, Operand::imm(0));
+      else if (inst.sub == '*' && b.val == -1)
+        inst = Inst(Op::UN, inst.dst, a, {}, '-');
+    }
+    if (block.term != Block::BR)
+      continue;
+    // a branch on !x or x != 0 tests x directly, one on x == 0 swaps arms
+    for (Inst *src; (src = def_of(block.cond, Op::UN)) ||
+                    (src = def_of(block.cond, Op::BIN));) {
+      if (src->op == Op::UN && src->sub == '!')
+        std::swap(block.succ[0], block.succ[1]);
+      else if (src->op == Op::BIN && (src->sub == 'n' || src->sub == 'e') &&
+               src->b == Operand::imm(0)) {
+        if (src->sub == 'e')
+          std::swap(block.succ[0], block.succ[1]);
+      } else
+        break;
+      block.cond = src->a;
+    }
+  }
+}
+
+// Dominator-based global value numbering: a pure computation that repeats
+// one available on every path to it becomes a copy of the earlier result.
+void gvn(Function &func) {
+  using Key = std::tuple<Op, char, Operand::Kind, int32_t, Operand::Kind,
+                         int32_t>;
+  std::vector<int32_t> idom = func.idom();
+  std::vector<std::vector<int32_t>> children(func.blocks.size());
+  for (size_t b = 1; b < func.blocks.size(); ++b)
+    if (idom[b] != -1)
+      children[idom[b]].push_back(static_cast<int32_t>(b));
+  std::vector<Operand> repl(func.ntemps);
+  auto find = [&](Operand opd) {
+    while (opd.is_temp() && repl[opd.val].kind != Operand::NONE)
+      opd = repl[opd.val];
+    return opd;
+  };
+  std::map<Key, Operand> table;
+  std::vector<std::map<Key, Operand>::iterator> added;
+  std::vector<std::pair<int32_t, size_t>> work = {{0, SIZE_MAX}};
+  while (!work.empty()) {
+    auto [b, mark] = work.back();
+    work.pop_back();
+    if (mark != SIZE_MAX) {
+      for (; added.size() > mark; added.pop_back())
+        table.erase(added.back());
+      continue;
+    }
+    work.emplace_back(b, added.size());
+    for (auto &inst : func.blocks[b].insts) {
+      for_uses(inst, [&](Operand &opd) { opd = find(opd); });
+      if ((inst.op != Op::BIN && inst.op != Op::UN && inst.op != Op::FRAME) ||
+          inst.a.kind == Operand::MEM || inst.b.kind == Operand::MEM ||
+          !inst.dst.is_temp())
+        continue;
+      Operand a = inst.a, b = inst.b;
+      if (is_commutative(inst.sub) && std::tie(b.kind, b.val) <
+                                          std::tie(a.kind, a.val))
+        std::swap(a, b);
+      auto [it, fresh] = table.try_emplace(
+          Key(inst.op, inst.sub, a.kind, a.val, b.kind, b.val), inst.dst);
+      if (fresh)
+        added.push_back(it);
+      else
+        repl[inst.dst.val] = it->second, inst = Inst(Op::MOV, inst.dst,
+                                                     it->second);
+    }
+    for (int32_t child : children[b])
+      work.emplace_back(child, SIZE_MAX);
+  }
+  replace_uses(func, repl);
+}
+
+// Forwards copies between temporaries and phis whose arguments all agree.
+void copy_prop(Function &func) {
+  std::vector<Operand> repl(func.ntemps);
+  auto find = [&](Operand opd) {
+    while (opd.is_temp() && repl[opd.val].kind != Operand::NONE)
+      opd = repl[opd.val];
+    return opd;
+  };
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto &block : func.blocks)
+      for (auto &inst : block.insts) {
+        if (!inst.dst.is_temp() || repl[inst.dst.val].kind != Operand::NONE)
+          continue;
+        Operand same;
+        if (inst.op == Op::MOV && inst.a.kind != Operand::MEM)
+          same = find(inst.a);
+        else if (inst.op == Op::PHI) {
+          for (const auto &arg : inst.args) {
+            Operand val = find(arg);
+            if (val == inst.dst || val == same)
+              continue;
+            if (same.kind != Operand::NONE) {
+              same = Operand();
+              break;
+            }
+            same = val;
+          }
+        }
+        if (same.kind != Operand::NONE && same != inst.dst)
+          repl[inst.dst.val] = same, changed = true;
+      }
+  }
+  replace_uses(func, repl);
+  for (auto &block : func.blocks)
+    std::erase_if(block.insts, [&](const Inst &inst) {
+      return inst.dst.is_temp() && repl[inst.dst.val].kind != Operand::NONE;
+    });
+}
+
+// Removes computations whose results never reach a side effect, a global,
+// a branch or a return.
+void dce(Function &func) {
+  std::vector<Inst *> def = def_map(func);
+  std::vector<char> live(func.ntemps);
+  std::vector<Inst *> work;
+  auto use = [&](Operand &opd) {
+    if (!live[opd.val]) {
+      live[opd.val] = 1;
+      if (def[opd.val])
+        work.push_back(def[opd.val]);
+    }
+  };
+  for (auto &block : func.blocks) {
+    for (auto &inst : block.insts)
+      if (inst.has_side_effect() || !inst.dst.is_temp() || may_trap(inst))
+        work.push_back(&inst);
+    if (block.cond.is_temp())
+      use(block.cond);
+  }
+  while (!work.empty()) {
+    Inst *inst = work.back();
+    work.pop_back();
+    for_uses(*inst, use);
+  }
+  for (auto &block : func.blocks) {
+    std::erase_if(block.insts, [&](const Inst &inst) {
+      return inst.dst.is_temp() && !live[inst.dst.val] &&
+             !inst.has_side_effect() && !may_trap(inst);
+    });
+    for (auto &inst : block.insts)
+      if (inst.op == Op::CALL && inst.dst.is_temp() && !live[inst.dst.val])
+        inst.dst = Operand();
+  }
+}
+
+// Turns branches with equal arms into jumps and merges a block into its
+// predecessor when it is that predecessor's only successor and vice versa.
+void simplify_cfg(Function &func) {
+  func.compute_preds();
+  for (int32_t b = 0; b < static_cast<int32_t>(func.blocks.size()); ++b) {
+    Block &block = func.blocks[b];
+    if (block.term == Block::BR && block.succ[0] == block.succ[1]) {
+      block.term = Block::JMP, block.cond = Operand();
+      Block &succ = func.blocks[block.succ[0]];
+      succ.preds.erase(std::find(succ.preds.begin(), succ.preds.end(), b));
+      for (auto &phi : succ.insts) {
+        if (phi.op != Op::PHI)
+          break;
+        auto it = std::find(phi.from.begin(), phi.from.end(), b);
+        phi.args.erase(phi.args.begin() + (it - phi.from.begin()));
+        phi.from.erase(it);
+      }
+    }
+    while (block.term == Block::JMP && block.succ[0] != b &&
+           block.succ[0] != 0 && func.blocks[block.succ[0]].preds.size() == 1) {
+      int32_t s = block.succ[0];
+      Block &succ = func.blocks[s];
+      for (auto &inst : succ.insts) {
+        if (inst.op == Op::PHI)
+          inst = Inst(Op::MOV, inst.dst, inst.args[0]);
+        block.insts.push_back(std::move(inst));
+      }
+      block.term = succ.term, block.cond = succ.cond;
+      block.succ[0] = succ.succ[0], block.succ[1] = succ.succ[1];
+      succ.insts.clear(), succ.preds.clear();
+      succ.term = Block::RET, succ.cond = Operand();
+      for (int32_t k = 0; k < block.succ_count(); ++k) {
+        Block &next = func.blocks[block.succ[k]];
+        std::replace(next.preds.begin(), next.preds.end(), s, b);
+        for (auto &phi : next.insts) {
+          if (phi.op != Op::PHI)
+            break;
+          std::replace(phi.from.begin(), phi.from.end(), s, b);
+        }
+      }
+    }
+  }
+  func.remove_unreachable();
+}
+
+PassManager::PassManager(int level, int32_t inline_threshold) {
+  if (level <= 0)
+    return;
+  this->inline_threshold = inline_threshold;
+  tail_calls = true;
+  passes.push_back({"to-ssa", to_ssa});
+  if (level == 1)
+    passes.insert(passes.end(), {{"sccp", sccp},
+                                 {"copy-prop", copy_prop},
+                                 {"ranges", remove_bounds_checks},
+                                 {"dce", dce},
+                                 {"simplify-cfg", simplify_cfg}});
+  else
+    for (int round = 0; round < 2; ++round) {
+      if (round)
+        passes.push_back({"loops", optimize_loops});
+      passes.insert(passes.end(), {{"sccp", sccp},
+                                   {"simplify", simplify},
+                                   {"gvn", gvn},
+                                   {"copy-prop", copy_prop},
+                                   {"ranges", remove_bounds_checks},
+                                   {"dce", dce},
+                                   {"simplify-cfg", simplify_cfg}});
+    }
+  passes.push_back({"from-ssa", from_ssa});
+  passes.push_back({"layout", layout});
+}
+
+void PassManager::run(Module &mod) const {
+  run_module(mod);
+  for (int32_t f = 0; f < static_cast<int32_t>(mod.funcs.size()); ++f)
+    run(mod, f);
+}
+
+void PassManager::run_module(Module &mod) const {
+  if (tail_calls) {
+    TimeReport::Timer timer("tail recursion");
+    eliminate_tail_recursion(mod);
+  }
+  if (inline_threshold >= 0) {
+    TimeReport::Timer timer("inlining");
+    inline_calls(mod, inline_threshold);
+  }
+}
+
+void PassManager::run(Module &mod, int32_t func_id) const {
+  for (const auto &pass : passes) {
+    TimeReport::Timer timer(pass.name, true);
+    pass.run(mod.funcs[func_id]);
+  }
+  if (tail_calls) {
+    TimeReport::Timer timer("tail-calls", true);
+    mark_tail_calls(mod, func_id);
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef FLEA_OPT_HPP_FLAG
+#define FLEA_OPT_HPP_FLAG
+
+#include "flea_ir.hpp"
+#include <vector>
+
+// Calls fn on every temporary read by the instruction.
+template <typename Fn> void for_uses(Inst &inst, Fn fn) {
+  if (inst.a.is_temp())
+    fn(inst.a);
+  if (inst.b.is_temp())
+    fn(inst.b);
+  for (auto &arg : inst.args)
+    if (arg.is_temp())
+      fn(arg);
+}
+
+// SSA construction and destruction; every pass between them expects SSA.
+void to_ssa(Function &func);
+void from_ssa(Function &func);
+
+void sccp(Function &func);
+void simplify(Function &func);
+void gvn(Function &func);
+void copy_prop(Function &func);
+void dce(Function &func);
+void simplify_cfg(Function &func);
+void optimize_loops(Function &func);
+void remove_bounds_checks(Function &func);
+
+// Orders the blocks of a function out of SSA for the fewest taken jumps.
+void layout(Function &func);
+
+// Inlines, callees first, the calls to non-recursive functions that are
+// called once or cost at most threshold IR instructions, while the caller
+// stays within a budget of 64 times the threshold over its own size, then
+// drops the functions left uncalled and fixes parameters that are always
+// passed the same constant.
+void inline_calls(Module &mod, int32_t threshold);
+
+// Turns self-recursive tail calls into loops, using an accumulator for
+// returns of the form f(...) + e or f(...) * e. Functions with local arrays
+// keep their calls, as every call needs arrays of its own.
+void eliminate_tail_recursion(Module &mod);
+
+// Marks the calls of a function that the emitter may turn into jumps
+// reusing the frame: those whose result is returned right away, outside
+// main and functions with local arrays, to callees that take no more
+// parameters than the caller.
+void mark_tail_calls(Module &mod, int32_t func_id);
+
+// Whether the instruction can trap, i.e. is a division by a possible zero.
+bool may_trap(const Inst &inst);
+
+// Evaluates a BIN or UN instruction on constants; false if it would trap.
+bool fold(char op, bool unary, int32_t a, int32_t b, int32_t &result);
+
+// The comparison that gives the same result with swapped operands.
+char mirror(char op);
+
+// The comparison that gives the opposite result, 0 for other operators.
+char invert(char op);
+
+// Runs the pipeline of an optimization level over every function:
+// -O0 lowers the AST as is, -O1 runs the cheap SSA cleanups and -O2 adds
+// algebraic simplification and value numbering, iterated around the loop
+// optimizations. From -O1 on, tail recursion is removed and calls are
+// inlined first unless inline_threshold is negative, and the blocks are laid
+// out and the tail calls marked last. The passes that look across functions
+// all run first, in run_module; after them each function's pipeline only
+// reads the others.
+class PassManager {
+public:
+  static constexpr int32_t default_inline_threshold = 32;
+  struct Pass {
+    const char *name;
+    void (*run)(Function &func);
+  };
+  std::vector<Pass> passes;
+  int32_t inline_threshold = -1;
+  bool tail_calls = false;
+  PassManager(int level, int32_t inline_threshold = default_inline_threshold);
+  void run(Module &mod) const;
+  void run_module(Module &mod) const;
+  void run(Module &mod, int32_t func_id) const;
+};
+
+#endif // FLEA_OPT_HPP_FLAG
@@ -0,0 +1,61 @@
+#include "flea_pool.hpp"
+
+ThreadPool::ThreadPool(unsigned size) {
+  for (unsigned worker = 1; worker < size; ++worker)
+    threads.emplace_back([this, worker] {
+      uint64_t seen = 0;
+      for (;;) {
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          wake.wait(guard, [&] { return stopping || job != seen; });
+          if (stopping)
+            return;
+          seen = job;
+        }
+        work(worker);
+        std::lock_guard<std::mutex> guard(lock);
+        if (!--busy)
+          done.notify_one();
+      }
+    });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &thread : threads)
+    thread.join();
+}
+
+void ThreadPool::run(size_t count,
+                     const std::function<void(unsigned, size_t)> &body) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    this->body = &body, this->count = count;
+    next = 0, failed = false, error = nullptr;
+    busy = static_cast<unsigned>(threads.size());
+    ++job;
+  }
+  wake.notify_all();
+  work(0);
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [&] { return !busy; });
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void ThreadPool::work(unsigned worker) {
+  for (size_t i; !failed && (i = next++) < count;) {
+    try {
+      (*body)(worker, i);
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (!error || i < error_index)
+        error = std::current_exception(), error_index = i;
+      failed = true;
+    }
+  }
+}
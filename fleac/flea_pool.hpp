@@ -0,0 +1,45 @@
+#ifndef FLEA_POOL_HPP_FLAG
+#define FLEA_POOL_HPP_FLAG
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, the calling thread being worker 0, that
+// share out the indices of a job. Workers take the indices in increasing
+// order, and none is taken after one has thrown. The error that run passes
+// on is the one of the smallest index, the error a sequential loop would
+// have stopped at.
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned size);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+  unsigned size() const { return static_cast<unsigned>(threads.size()) + 1; }
+  // calls body(worker, i) for every i below count
+  void run(size_t count, const std::function<void(unsigned, size_t)> &body);
+
+private:
+  std::vector<std::thread> threads;
+  std::mutex lock;
+  std::condition_variable wake, done;
+  const std::function<void(unsigned, size_t)> *body = nullptr;
+  size_t count = 0;
+  std::atomic<size_t> next{0};
+  std::atomic<bool> failed{false};
+  unsigned busy = 0;
+  uint64_t job = 0;
+  bool stopping = false;
+  size_t error_index = 0;
+  std::exception_ptr error;
+  void work(unsigned worker);
+};
+
+#endif // FLEA_POOL_HPP_FLAG
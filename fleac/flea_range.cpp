@@ -0,0 +1,257 @@
+#include "flea_expr.hpp"
+#include "flea_opt.hpp"
+#include <algorithm>
+#include <optional>
+#include <set>
+
+// Bounds of a value, kept wide so that they combine without overflow.
+struct Range {
+  int64_t lo = INT32_MIN, hi = INT32_MAX;
+};
+
+// A range computed from others, or every value if it may have wrapped.
+static Range wrap(int64_t lo, int64_t hi) {
+  if (lo < INT32_MIN || hi > INT32_MAX)
+    return {};
+  return {lo, hi};
+}
+
+namespace {
+// Finds the ranges of temporaries on demand: from their definitions, and
+// at a block narrowed by the comparisons on the branches that lead to it
+// and by the bounds checks before it. The walk through definitions is cut
+// off at max_depth.
+class RangeFinder {
+public:
+  explicit RangeFinder(Function &func);
+  Range at(const Operand &opd, int32_t block, int32_t depth);
+
+private:
+  static constexpr int32_t max_depth = 8;
+  Function &func;
+  std::vector<Inst *> def;
+  std::vector<int32_t> def_block, idom;
+  std::vector<std::vector<const Inst *>> checks;
+  // what is assumed of the phis being found, and what is known for good
+  std::vector<std::optional<Range>> assumed, known;
+  int32_t assuming = 0;
+  Range of(int32_t t, int32_t depth);
+  Range binary(const Inst &inst, int32_t block, int32_t depth);
+  Range phi(const Inst &inst, int32_t depth);
+  std::optional<Range> induction(const Inst &phi, int32_t depth);
+  Range narrow(int32_t t, Range r, int32_t block, int32_t depth);
+  Range guard(int32_t t, Range r, int32_t cond, bool taken, int32_t block,
+              int32_t depth);
+};
+} // namespace
+
+RangeFinder::RangeFinder(Function &func)
+    : func(func), def(func.ntemps), def_block(func.ntemps, -1),
+      checks(func.blocks.size()), assumed(func.ntemps), known(func.ntemps) {
+  func.compute_preds();
+  idom = func.idom();
+  for (int32_t b = 0; b < static_cast<int32_t>(func.blocks.size()); ++b)
+    for (auto &inst : func.blocks[b].insts) {
+      if (inst.dst.is_temp())
+        def[inst.dst.val] = &inst, def_block[inst.dst.val] = b;
+      if (inst.op == Op::CHECK)
+        checks[b].push_back(&inst);
+    }
+}
+
+Range RangeFinder::at(const Operand &opd, int32_t block, int32_t depth) {
+  if (opd.is_imm())
+    return {opd.val, opd.val};
+  if (!opd.is_temp())
+    return {};
+  return narrow(opd.val, of(opd.val, depth), block, depth);
+}
+
+Range RangeFinder::of(int32_t t, int32_t depth) {
+  if (assumed[t])
+    return *assumed[t];
+  if (known[t])
+    return *known[t];
+  if (depth > max_depth || !def[t])
+    return {};
+  const Inst &inst = *def[t];
+  int32_t block = def_block[t];
+  Range r;
+  switch (inst.op) {
+  case Op::MOV:
+    r = at(inst.a, block, depth + 1);
+    break;
+  case Op::UN: {
+    Range x = at(inst.a, block, depth + 1);
+    r = inst.sub == '!' ? Range{0, 1} : wrap(-x.hi, -x.lo);
+    break;
+  }
+  case Op::BIN:
+    r = binary(inst, block, depth);
+    break;
+  case Op::PHI:
+    r = phi(inst, depth);
+    break;
+  default:
+    break;
+  }
+  if (!assuming)
+    known[t] = r;
+  return r;
+}
+
+Range RangeFinder::binary(const Inst &inst, int32_t block, int32_t depth) {
+  if (invert(inst.sub))
+    return {0, 1};
+  Range x = at(inst.a, block, depth + 1), y = at(inst.b, block, depth + 1);
+  switch (inst.sub) {
+  case '+':
+    return wrap(x.lo + y.lo, x.hi + y.hi);
+  case '-':
+    return wrap(x.lo - y.hi, x.hi - y.lo);
+  case '*': {
+    int64_t p[] = {x.lo * y.lo, x.lo * y.hi, x.hi * y.lo, x.hi * y.hi};
+    return wrap(*std::min_element(p, p + 4), *std::max_element(p, p + 4));
+  }
+  case '/':
+    if (!inst.b.is_imm() || inst.b.val <= 0)
+      return {};
+    return {floor_div(static_cast<int32_t>(x.lo), inst.b.val),
+            floor_div(static_cast<int32_t>(x.hi), inst.b.val)};
+  case '%':
+    if (y.lo <= 0)
+      return {};
+    if (x.lo >= 0 && x.hi < y.lo)
+      return x;
+    return {0, y.hi - 1};
+  default:
+    return {};
+  }
+}
+
+// The values a phi merges, each as it leaves its block.
+Range RangeFinder::phi(const Inst &inst, int32_t depth) {
+  if (auto r = induction(inst, depth))
+    return *r;
+  if (inst.args.empty())
+    return {};
+  assumed[inst.dst.val] = Range{}, ++assuming;
+  Range r{INT64_MAX, INT64_MIN};
+  for (size_t i = 0; i < inst.args.size(); ++i) {
+    Range x = at(inst.args[i], inst.from[i], depth + 1);
+    r.lo = std::min(r.lo, x.lo), r.hi = std::max(r.hi, x.hi);
+  }
+  assumed[inst.dst.val].reset(), --assuming;
+  return r;
+}
+
+// i = phi(init, i +- step) with a constant step only moves away from init
+// until it wraps. Assuming so, the range of i where the step is taken,
+// narrowed by the branches before it, bounds how far it gets; if that
+// cannot wrap, the assumption holds.
+std::optional<Range> RangeFinder::induction(const Inst &phi, int32_t depth) {
+  if (phi.args.size() != 2)
+    return std::nullopt;
+  for (size_t k = 0; k < 2; ++k) {
+    const Operand &next = phi.args[k], &init = phi.args[1 - k];
+    if (!next.is_temp() || !def[next.val])
+      continue;
+    const Inst &inc = *def[next.val];
+    if (inc.op != Op::BIN || (inc.sub != '+' && inc.sub != '-') ||
+        inc.a != phi.dst || !inc.b.is_imm() || inc.b.val == 0)
+      continue;
+    int64_t step = inc.sub == '+' ? inc.b.val : -int64_t{inc.b.val};
+    Range start = at(init, phi.from[1 - k], depth + 1);
+    assumed[phi.dst.val] = step > 0 ? Range{start.lo, INT32_MAX}
+                                    : Range{INT32_MIN, start.hi};
+    ++assuming;
+    Range before = at(phi.dst, def_block[next.val], depth + 1);
+    assumed[phi.dst.val].reset(), --assuming;
+    Range r = step > 0 ? Range{start.lo, std::max(start.hi, before.hi + step)}
+                       : Range{std::min(start.lo, before.lo + step), start.hi};
+    return wrap(r.lo, r.hi);
+  }
+  return std::nullopt;
+}
+
+// Walks up the dominators of block: a branch whose arm is the only way
+// into the block below it tells how its condition came out, and a bounds
+// check that passed tells that its subscript is in range.
+Range RangeFinder::narrow(int32_t t, Range r, int32_t block, int32_t depth) {
+  for (int32_t c = block; c != 0 && idom[c] != -1;) {
+    int32_t p = idom[c];
+    const Block &pred = func.blocks[p];
+    if (pred.term == Block::BR && pred.succ[0] != pred.succ[1] &&
+        pred.cond.is_temp() && func.blocks[c].preds.size() == 1)
+      r = guard(t, r, pred.cond.val, pred.succ[0] == c, p, depth);
+    for (const Inst *check : checks[p])
+      if (check->a == Operand::temp(t))
+        r.lo = std::max<int64_t>(r.lo, 0),
+        r.hi = std::min<int64_t>(r.hi, check->b.val - 1);
+    c = p;
+  }
+  return r;
+}
+
+Range RangeFinder::guard(int32_t t, Range r, int32_t cond, bool taken,
+                         int32_t block, int32_t depth) {
+  if (cond == t) {
+    if (!taken)
+      r.lo = std::max<int64_t>(r.lo, 0), r.hi = std::min<int64_t>(r.hi, 0);
+    return r;
+  }
+  const Inst *cmp = def[cond];
+  if (!cmp || cmp->op != Op::BIN || !invert(cmp->sub))
+    return r;
+  char op = cmp->sub;
+  Operand other;
+  if (cmp->a == Operand::temp(t))
+    other = cmp->b;
+  else if (cmp->b == Operand::temp(t))
+    other = cmp->a, op = mirror(op);
+  else
+    return r;
+  if (!taken)
+    op = invert(op);
+  Range y = at(other, block, depth + 1);
+  if (op == '<' || op == 'l')
+    r.hi = std::min(r.hi, y.hi - (op == '<'));
+  else if (op == '>' || op == 'g')
+    r.lo = std::max(r.lo, y.lo + (op == '>'));
+  else if (op == 'e')
+    r.lo = std::max(r.lo, y.lo), r.hi = std::min(r.hi, y.hi);
+  return r;
+}
+
+// Drops the bounds checks whose subscripts are proven in range, and those
+// repeating one made earlier in their block.
+void remove_bounds_checks(Function &func) {
+  bool any = false;
+  for (const auto &block : func.blocks)
+    for (const auto &inst : block.insts)
+      any |= inst.op == Op::CHECK;
+  if (!any)
+    return;
+  // the finder points into the blocks, so they change only at the end
+  RangeFinder ranges(func);
+  std::vector<std::vector<char>> drop(func.blocks.size());
+  for (int32_t b = 0; b < static_cast<int32_t>(func.blocks.size()); ++b) {
+    const auto &insts = func.blocks[b].insts;
+    std::set<std::pair<int32_t, int32_t>> done;
+    drop[b].assign(insts.size(), 0);
+    for (size_t i = 0; i < insts.size(); ++i) {
+      const Inst &inst = insts[i];
+      if (inst.op != Op::CHECK)
+        continue;
+      Range r = ranges.at(inst.a, b, 0);
+      drop[b][i] = (r.lo >= 0 && r.hi < inst.b.val) ||
+                   (inst.a.is_temp() &&
+                    !done.emplace(inst.a.val, inst.b.val).second);
+    }
+  }
+  for (size_t b = 0; b < func.blocks.size(); ++b) {
+    auto &insts = func.blocks[b].insts;
+    size_t i = 0;
+    std::erase_if(insts, [&](const Inst &) { return drop[b][i++]; });
+  }
+}
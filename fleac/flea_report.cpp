@@ -0,0 +1,246 @@
+#include "flea_report.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
+TimeReport *TimeReport::active = nullptr;
+
+// Heap allocations on all threads and on this one, counted only while a
+// report is active so that compiling without one pays a single test.
+static std::atomic<bool> counting{false};
+static std::atomic<uint64_t> all_allocs{0}, all_bytes{0};
+static thread_local uint64_t thread_allocs = 0, thread_bytes = 0;
+// the innermost phase being timed on this thread
+static thread_local TimeReport::Timer *current = nullptr;
+
+static void *allocate(size_t size) {
+  if (counting.load(std::memory_order_relaxed)) {
+    ++thread_allocs, thread_bytes += size;
+    all_allocs.fetch_add(1, std::memory_order_relaxed);
+    all_bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+  return malloc(size ? size : 1);
+}
+
+void *operator new(size_t size) {
+  if (void *p = allocate(size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+
+// CPU time of this thread, so that a pass run on a worker is not charged
+// for the time the worker spends preempted by the others.
+static double thread_cpu_ms() {
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+  auto ticks = [](const FILETIME &t) {
+    return static_cast<uint64_t>(t.dwHighDateTime) << 32 | t.dwLowDateTime;
+  };
+  return static_cast<double>(ticks(kernel) + ticks(user)) / 1e4;
+#else
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return static_cast<double>(now.tv_sec) * 1e3 +
+         static_cast<double>(now.tv_nsec) / 1e6;
+#endif
+}
+
+TimeReport::Counts &TimeReport::Counts::operator+=(const Counts &other) {
+  ms += other.ms, allocs += other.allocs, bytes += other.bytes;
+  return *this;
+}
+
+TimeReport::Counts &TimeReport::Counts::operator-=(const Counts &other) {
+  ms -= other.ms, allocs -= other.allocs, bytes -= other.bytes;
+  return *this;
+}
+
+TimeReport::Timer::Timer(const char *name, bool pass) : pass(pass) {
+  if (!active)
+    return;
+  this->name = name;
+  if (pass) {
+    allocs = thread_allocs, bytes = thread_bytes;
+    cpu_start = thread_cpu_ms();
+    return;
+  }
+  active->phase(name);
+  allocs = all_allocs, bytes = all_bytes;
+  outer = current, current = this;
+  start = std::chrono::steady_clock::now();
+}
+
+TimeReport::Timer::~Timer() {
+  if (!name)
+    return;
+  Counts counts;
+  if (pass) {
+    counts.ms = thread_cpu_ms() - cpu_start;
+    counts.allocs = thread_allocs - allocs;
+    counts.bytes = thread_bytes - bytes;
+    active->add_pass(name, counts);
+    return;
+  }
+  counts.ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  counts.allocs = all_allocs - allocs;
+  counts.bytes = all_bytes - bytes;
+  current = outer;
+  if (outer)
+    outer->nested += counts;
+  active->phase(name) += (counts -= nested);
+}
+
+TimeReport::TimeReport() { active = this, counting = true; }
+TimeReport::~TimeReport() { active = nullptr, counting = false; }
+
+// Phases are timed from the main thread only, and listed in the order
+// they first started.
+TimeReport::Counts &TimeReport::phase(const std::string &name) {
+  for (auto &[phase_name, counts] : phases)
+    if (phase_name == name)
+      return counts;
+  return phases.emplace_back(name, Counts()).second;
+}
+
+void TimeReport::add_pass(const char *name, const Counts &counts) {
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto &[pass_name, total] : passes)
+    if (pass_name == name) {
+      total += counts;
+      return;
+    }
+  passes.emplace_back(name, counts);
+}
+
+void TimeReport::count_node(std::type_index type) {
+  std::lock_guard<std::mutex> guard(lock);
+  ++nodes[type];
+}
+
+void TimeReport::set(const std::string &name, uint64_t value) {
+  sizes.emplace_back(name, value);
+}
+
+static std::string class_name(std::type_index type) {
+  std::string name = type.name();
+#ifdef __GNUG__
+  int status = 0;
+  if (char *plain = abi::__cxa_demangle(name.c_str(), nullptr, nullptr,
+                                        &status)) {
+    name = plain;
+    free(plain);
+  }
+#endif
+  if (!name.compare(0, 6, "class "))
+    name.erase(0, 6);
+  return name;
+}
+
+static uint64_t peak_rss_kib() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                               sizeof counters))
+    return 0;
+  return counters.PeakWorkingSetSize >> 10;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0;
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+}
+
+static void print_header(std::ostream &out, const char *title,
+                         const char *time) {
+  char line[128];
+  snprintf(line, sizeof line, "%-28s %10s %12s %14s\n", title, time, "allocs",
+           "bytes");
+  out << line;
+}
+
+static void print_row(std::ostream &out, const std::string &name,
+                      const TimeReport::Counts &counts) {
+  char line[128];
+  snprintf(line, sizeof line, "  %-26s %10.2f %12llu %14llu\n", name.c_str(),
+           counts.ms, static_cast<unsigned long long>(counts.allocs),
+           static_cast<unsigned long long>(counts.bytes));
+  out << line;
+}
+
+static void print_json(std::ostream &out, const char *key,
+                       const std::vector<std::pair<std::string,
+                                                   TimeReport::Counts>> &rows) {
+  out << "  \"" << key << "\": [";
+  for (size_t i = 0; i < rows.size(); ++i)
+    out << (i ? ",\n    " : "\n    ") << "{\"name\": \"" << rows[i].first
+        << "\", \"ms\": " << rows[i].second.ms
+        << ", \"allocs\": " << rows[i].second.allocs
+        << ", \"bytes\": " << rows[i].second.bytes << "}";
+  out << "\n  ],\n";
+}
+
+void TimeReport::print(std::ostream &out, bool json) const {
+  std::map<std::string, uint64_t> node_counts;
+  uint64_t node_total = 0;
+  for (auto [type, count] : nodes)
+    node_counts[class_name(type)] += count, node_total += count;
+  uint64_t rss = peak_rss_kib();
+  if (json) {
+    out << "{\n";
+    print_json(out, "phases", phases);
+    print_json(out, "passes", passes);
+    out << "  \"ast_nodes\": {";
+    const char *sep = "\n    ";
+    for (const auto &[name, count] : node_counts)
+      out << sep << "\"" << name << "\": " << count, sep = ",\n    ";
+    out << "\n  },\n  \"sizes\": {";
+    sep = "\n    ";
+    for (const auto &[name, value] : sizes)
+      out << sep << "\"" << name << "\": " << value, sep = ",\n    ";
+    out << sep << "\"peak_rss_kib\": " << rss << "\n  }\n}\n";
+    return;
+  }
+  Counts total;
+  print_header(out, "Phase", "wall ms");
+  for (const auto &[name, counts] : phases)
+    print_row(out, name, counts), total += counts;
+  print_row(out, "total", total);
+  if (!passes.empty()) {
+    print_header(out, "Pass, over all functions", "cpu ms");
+    for (const auto &[name, counts] : passes)
+      print_row(out, name, counts);
+  }
+  out << "AST nodes made\n";
+  for (const auto &[name, count] : node_counts)
+    out << "  " << name << ": " << count << "\n";
+  out << "  total: " << node_total << "\n";
+  out << "Sizes\n";
+  for (const auto &[name, value] : sizes)
+    out << "  " << name << ": " << value << "\n";
+  out << "  peak RSS (KiB): " << rss << "\n";
+}
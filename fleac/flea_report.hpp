@@ -0,0 +1,66 @@
+#ifndef FLEA_REPORT_HPP_FLAG
+#define FLEA_REPORT_HPP_FLAG
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <utility>
+#include <vector>
+
+// Statistics behind --time-report: the wall time of each phase with the
+// heap allocations made meanwhile on all threads, the thread CPU time and
+// allocations of each optimization pass summed over functions (with -j
+// they may add up to more than the phase's wall time), the AST nodes made
+// by class, a few sizes and the peak resident set size. Nested phases are
+// left out of the phase they run in. Allocations are only counted while a
+// report is active.
+class TimeReport {
+public:
+  struct Counts {
+    double ms = 0;
+    uint64_t allocs = 0, bytes = 0;
+    Counts &operator+=(const Counts &other);
+    Counts &operator-=(const Counts &other);
+  };
+
+  // Measures from construction to destruction into the phase or, for a
+  // pass, the pass of that name; does nothing without an active report.
+  class Timer {
+  public:
+    Timer(const char *name, bool pass = false);
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+    ~Timer();
+
+  private:
+    const char *name = nullptr;
+    bool pass;
+    std::chrono::steady_clock::time_point start;
+    double cpu_start = 0;
+    uint64_t allocs = 0, bytes = 0;
+    Counts nested;
+    Timer *outer = nullptr;
+  };
+
+  // the report being gathered, null unless asked for
+  static TimeReport *active;
+  TimeReport();
+  ~TimeReport();
+  Counts &phase(const std::string &name);
+  void count_node(std::type_index type);
+  void set(const std::string &name, uint64_t value);
+  void print(std::ostream &out, bool json) const;
+
+private:
+  std::vector<std::pair<std::string, Counts>> phases, passes;
+  std::map<std::type_index, uint64_t> nodes;
+  std::vector<std::pair<std::string, uint64_t>> sizes;
+  std::mutex lock;
+  void add_pass(const char *name, const Counts &counts);
+};
+
+#endif // FLEA_REPORT_HPP_FLAG
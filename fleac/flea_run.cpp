@@ -0,0 +1,48 @@
+#include "flea_run.hpp"
+
+// the VM is not written to the warnings the compiler is built with
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wconversion"
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wpedantic"
+#include "../flea/flea_vm.hpp"
+#pragma GCC diagnostic pop
+
+static flea::value to_value(const FleaOpd &o) {
+  switch (o.type) {
+  case 0:
+    return flea::value();
+  case '[':
+    return flea::value(flea::value(o.base_type, o.val),
+                       flea::value(o.idx_type, o.idx));
+  default:
+    return flea::value(o.type, o.val);
+  }
+}
+
+void run_program(const std::vector<int32_t> &data,
+                 const std::vector<FleaCode> &code,
+                 [[maybe_unused]] const LineTable &lines) {
+  using namespace flea;
+  signal(SIGINT, sigint_handler);
+  cin.tie(nullptr)->sync_with_stdio(false);
+  try {
+    if (data.size() > memory_size)
+      throw interpreted_error("Invalid data segment");
+    std::copy(data.begin(), data.end(), memory);
+    codes.reserve(code.size());
+    for (const auto &c : code)
+      codes.emplace_back(from_code_name(c.op), to_value(c.a), to_value(c.b),
+                         to_value(c.c));
+#ifdef LINE_TABLE_ENABLED
+    source_file = lines.file;
+    source_funcs = lines.funcs;
+    for (const auto &row : lines.rows)
+      source_rows.push_back({row.line, row.src_line, row.func});
+#endif
+    cin.clear();
+    run();
+  } catch (exception &e) {
+    exit_with_error(e.what());
+  }
+}
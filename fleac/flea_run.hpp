@@ -0,0 +1,16 @@
+#ifndef FLEA_RUN_HPP_FLAG
+#define FLEA_RUN_HPP_FLAG
+
+#include "flea_emit.hpp"
+#include <cstdint>
+#include <vector>
+
+// Loads data and the linked code into the VM of this process and runs
+// them as the VM runs the file link_module writes, on the same standard
+// streams and exiting the same way, with errors placed in the source by
+// lines. Does not return.
+[[noreturn]] void run_program(const std::vector<int32_t> &data,
+                              const std::vector<FleaCode> &code,
+                              const LineTable &lines);
+
+#endif // FLEA_RUN_HPP_FLAG
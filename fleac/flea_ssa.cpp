@@ -0,0 +1,237 @@
+#include "flea_ir.hpp"
+#include "flea_opt.hpp"
+#include <algorithm>
+
+// Semi-pruned SSA construction after Cytron et al.: phis are placed on the
+// iterated dominance frontier of temporaries that are live across blocks.
+void to_ssa(Function &func) {
+  func.remove_unreachable();
+  auto n = func.blocks.size();
+  std::vector<int32_t> idom = func.idom();
+  std::vector<std::vector<int32_t>> frontier(n), children(n);
+  for (size_t b = 0; b < n; ++b) {
+    if (b)
+      children[idom[b]].push_back(static_cast<int32_t>(b));
+    if (func.blocks[b].preds.size() < 2)
+      continue;
+    for (int32_t runner : func.blocks[b].preds)
+      for (; runner != idom[b]; runner = idom[runner])
+        if (frontier[runner].empty() ||
+            frontier[runner].back() != static_cast<int32_t>(b))
+          frontier[runner].push_back(static_cast<int32_t>(b));
+  }
+
+  auto ntemps = static_cast<size_t>(func.ntemps);
+  std::vector<std::vector<int32_t>> def_blocks(ntemps);
+  std::vector<char> global(ntemps);
+  for (int32_t i = 0; i < func.nparams; ++i)
+    def_blocks[i].push_back(0);
+  // the block that last wrote each temporary, and the temporary each block
+  // was last queued for
+  std::vector<int32_t> killed(ntemps, -1), queued(n, -1);
+  for (size_t b = 0; b < n; ++b) {
+    Block &block = func.blocks[b];
+    auto use = [&](Operand &opd) {
+      if (killed[opd.val] != static_cast<int32_t>(b))
+        global[opd.val] = 1;
+    };
+    for (auto &inst : block.insts) {
+      for_uses(inst, use);
+      if (inst.dst.is_temp()) {
+        killed[inst.dst.val] = static_cast<int32_t>(b);
+        if (def_blocks[inst.dst.val].empty() ||
+            def_blocks[inst.dst.val].back() != static_cast<int32_t>(b))
+          def_blocks[inst.dst.val].push_back(static_cast<int32_t>(b));
+      }
+    }
+    if (block.cond.is_temp())
+      use(block.cond);
+  }
+
+  std::vector<int32_t> has_phi(n, -1);
+  for (size_t t = 0; t < ntemps; ++t) {
+    if (!global[t])
+      continue;
+    std::vector<int32_t> work = def_blocks[t];
+    for (int32_t b : work)
+      queued[b] = static_cast<int32_t>(t);
+    while (!work.empty()) {
+      int32_t b = work.back();
+      work.pop_back();
+      for (int32_t d : frontier[b]) {
+        if (has_phi[d] == static_cast<int32_t>(t))
+          continue;
+        has_phi[d] = static_cast<int32_t>(t);
+        Inst phi(Op::PHI, Operand::temp(static_cast<int32_t>(t)));
+        phi.a = phi.dst;
+        auto &insts = func.blocks[d].insts;
+        insts.insert(insts.begin(), phi);
+        if (queued[d] != static_cast<int32_t>(t))
+          queued[d] = static_cast<int32_t>(t), work.push_back(d);
+      }
+    }
+  }
+
+  std::vector<std::vector<Operand>> stacks(ntemps);
+  for (int32_t i = 0; i < func.nparams; ++i)
+    stacks[i].push_back(Operand::temp(i));
+  auto top = [&](int32_t t) {
+    return stacks[t].empty() ? Operand::imm(0) : stacks[t].back();
+  };
+  std::vector<std::pair<int32_t, bool>> work = {{0, false}};
+  std::vector<std::vector<int32_t>> pushed(n);
+  while (!work.empty()) {
+    auto [b, done] = work.back();
+    work.pop_back();
+    if (done) {
+      for (int32_t t : pushed[b])
+        stacks[t].pop_back();
+      continue;
+    }
+    Block &block = func.blocks[b];
+    auto define = [&](Operand &dst) {
+      int32_t t = dst.val;
+      dst = Operand::temp(func.new_temp());
+      stacks[t].push_back(dst);
+      pushed[b].push_back(t);
+    };
+    for (auto &inst : block.insts) {
+      if (inst.op != Op::PHI)
+        for_uses(inst, [&](Operand &opd) { opd = top(opd.val); });
+      if (inst.dst.is_temp())
+        define(inst.dst);
+    }
+    if (block.cond.is_temp())
+      block.cond = top(block.cond.val);
+    for (int32_t k = 0; k < block.succ_count(); ++k)
+      for (auto &phi : func.blocks[block.succ[k]].insts) {
+        if (phi.op != Op::PHI)
+          break;
+        phi.args.push_back(top(phi.a.val));
+        phi.from.push_back(b);
+      }
+    work.emplace_back(b, true);
+    for (int32_t child : children[b])
+      work.emplace_back(child, false);
+  }
+  for (auto &block : func.blocks)
+    for (auto &inst : block.insts) {
+      if (inst.op != Op::PHI)
+        break;
+      inst.a = Operand();
+    }
+}
+
+// Sequentializes the parallel copies dst[i] = src[i] at the end of a block.
+static void parallel_copy(Function &func, Block &block,
+                          std::vector<std::pair<Operand, Operand>> copies) {
+  copies.erase(std::remove_if(copies.begin(), copies.end(),
+                              [](const auto &c) { return c.first == c.second; }),
+               copies.end());
+  while (!copies.empty()) {
+    auto ready = std::find_if(copies.begin(), copies.end(), [&](const auto &c) {
+      return std::none_of(copies.begin(), copies.end(), [&](const auto &d) {
+        return d.second == c.first;
+      });
+    });
+    if (ready != copies.end()) {
+      block.insts.emplace_back(Op::MOV, ready->first, ready->second);
+      copies.erase(ready);
+      continue;
+    }
+    Operand saved = copies.front().first, temp = Operand::temp(func.new_temp());
+    block.insts.emplace_back(Op::MOV, temp, saved);
+    for (auto &c : copies)
+      if (c.second == saved)
+        c.second = temp;
+  }
+}
+
+// Folds a copy d = s into the definition of s when s has no other use and
+// d is neither read nor written in between, as phi copies usually are.
+static void fold_copies(Function &func) {
+  std::vector<int32_t> uses(func.ntemps), defs(func.ntemps);
+  for (auto &block : func.blocks) {
+    for (auto &inst : block.insts) {
+      for_uses(inst, [&](Operand &opd) { ++uses[opd.val]; });
+      if (inst.dst.is_temp())
+        ++defs[inst.dst.val];
+    }
+    if (block.cond.is_temp())
+      ++uses[block.cond.val];
+  }
+  for (auto &block : func.blocks) {
+    auto &insts = block.insts;
+    for (size_t j = 0; j < insts.size(); ++j) {
+      Operand dst = insts[j].dst, src = insts[j].a;
+      if (insts[j].op != Op::MOV || !dst.is_temp() || !src.is_temp() ||
+          uses[src.val] != 1 || defs[src.val] != 1)
+        continue;
+      size_t i = j;
+      bool clobbered = false;
+      while (i-- > 0 && insts[i].dst != src) {
+        for_uses(insts[i], [&](Operand &opd) { clobbered |= opd == dst; });
+        clobbered |= insts[i].dst == dst;
+      }
+      if (i == SIZE_MAX || clobbered)
+        continue;
+      insts[i].dst = dst;
+      insts.erase(insts.begin() + static_cast<std::ptrdiff_t>(j--));
+    }
+  }
+}
+
+// Replaces phis by copies at the end of the predecessors, splitting the
+// critical edges so that copies never run on the wrong path or before the
+// branch reads its condition. Phis of a block with one predecessor simply
+// become copies in place.
+void from_ssa(Function &func) {
+  func.compute_preds();
+  for (auto &block : func.blocks) {
+    if (block.preds.size() != 1)
+      continue;
+    for (auto &inst : block.insts) {
+      if (inst.op != Op::PHI)
+        break;
+      inst = Inst(Op::MOV, inst.dst,
+                  inst.args.empty() ? Operand::imm(0) : inst.args[0]);
+    }
+  }
+  auto n = func.blocks.size();
+  for (size_t b = 0; b < n; ++b) {
+    if (func.blocks[b].term != Block::BR)
+      continue;
+    for (int32_t k = 0; k < 2; ++k) {
+      int32_t succ = func.blocks[b].succ[k];
+      if (func.blocks[succ].preds.size() < 2 ||
+          func.blocks[succ].insts.empty() ||
+          func.blocks[succ].insts.front().op != Op::PHI)
+        continue;
+      int32_t edge = func.new_block();
+      func.blocks[edge].term = Block::JMP;
+      func.blocks[edge].succ[0] = succ;
+      func.blocks[b].succ[k] = edge;
+      for (auto &phi : func.blocks[succ].insts) {
+        if (phi.op != Op::PHI)
+          break;
+        std::replace(phi.from.begin(), phi.from.end(),
+                     static_cast<int32_t>(b), edge);
+      }
+    }
+  }
+  std::vector<std::vector<std::pair<Operand, Operand>>> copies(
+      func.blocks.size());
+  for (auto &block : func.blocks) {
+    auto end = std::find_if(block.insts.begin(), block.insts.end(),
+                            [](const Inst &i) { return i.op != Op::PHI; });
+    for (auto it = block.insts.begin(); it != end; ++it)
+      for (size_t i = 0; i < it->from.size(); ++i)
+        copies[it->from[i]].emplace_back(it->dst, it->args[i]);
+    block.insts.erase(block.insts.begin(), end);
+  }
+  for (size_t b = 0; b < func.blocks.size(); ++b)
+    if (!copies[b].empty())
+      parallel_copy(func, func.blocks[b], std::move(copies[b]));
+  fold_copies(func);
+  func.compute_preds();
+}
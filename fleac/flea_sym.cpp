@@ -1,78 +1,121 @@
 #include "flea_sym.hpp"
 #include "flea_err.hpp"
 #include "flea_expr.hpp"
+#include <unordered_map>
 
-FuncSign::FuncSign(char returnType, const std::vector<char> &argTypes)
-    : returnType(returnType), argTypes(argTypes) {}
+// Names are kept in a deque so that the views keying the index stay valid.
+static std::deque<std::string> names;
+static std::unordered_map<std::string_view, int32_t> name_ids;
+
+Ident Ident::intern(std::string_view name) {
+  auto it = name_ids.find(name);
+  if (it != name_ids.end())
+    return {it->second};
+  auto id = static_cast<int32_t>(names.size());
+  name_ids.emplace(names.emplace_back(name), id);
+  return {id};
+}
+
+size_t Ident::count() { return names.size(); }
+
+const std::string &Ident::operator*() const {
+  return names[static_cast<size_t>(id)];
+}
+
+FuncSign::FuncSign(char returnType, const std::vector<char> &argTypes,
+                   BaseAST *def)
+    : returnType(returnType), argTypes(argTypes), def(def) {}
 bool FuncSign::operator==(const FuncSign &other) const {
   return returnType == other.returnType && argTypes == other.argTypes;
 }
 
-SymbolTable::SymbolTable(const SymbolTable *parent)
-    : offset(parent ? parent->offset : 0), parent(parent) {}
+int64_t ArrayInfo::stride(size_t d) const {
+  int64_t stride = 1;
+  for (size_t i = d + 1; i < dims.size(); ++i)
+    stride *= dims[i];
+  return stride;
+}
 
-void SymbolTable::clear() { table.clear(); }
-void SymbolTable::insert(const std::string &name, const Value &val) {
-  if (table.find(name) != table.end())
-    throw redefinition_error(name);
-  table[name] = val;
+void SymbolTable::push() { scopes.emplace_back(bindings.size(), offset); }
+void SymbolTable::pop() {
+  for (size_t i = bindings.size(); i-- > scopes.back().first;)
+    innermost[bindings[i].name.id] = bindings[i].shadowed;
+  bindings.resize(scopes.back().first);
+  offset = scopes.back().second;
+  scopes.pop_back();
 }
-void SymbolTable::insertConst(const std::string &name, int32_t val) {
-  insert(name, val);
+void SymbolTable::insert(Ident name, const Symbol &sym) {
+  auto id = static_cast<size_t>(name.id);
+  if (id >= innermost.size())
+    innermost.resize(id + 1, -1);
+  auto depth = static_cast<int32_t>(scopes.size());
+  int32_t &top = innermost[id];
+  if (top != -1 && bindings[top].depth == depth)
+    throw redefinition_error(*name);
+  bindings.push_back({name, depth, top, sym});
+  top = static_cast<int32_t>(bindings.size() - 1);
 }
-void SymbolTable::insertFunc(const std::string &name, const FuncSign &val) {
-  insert(name, val);
+void SymbolTable::insertConst(Ident name, int32_t val) {
+  insert(name, {Symbol::CONST, val});
 }
-void SymbolTable::insertVar(const std::string &name) { insert(name, offset++); }
-void SymbolTable::insertVar(const std::string &name, int64_t offset) {
-  insert(name, offset);
+void SymbolTable::insertFunc(Ident name, const FuncSign &val) {
+  insert(name, {Symbol::FUNC, 0, 0, &funcs.emplace_back(val)});
 }
-const Value &SymbolTable::lookup(const std::string &name) const {
-  auto it = table.find(name);
-  if (it != table.end())
-    return it->second;
-  if (parent)
-    return parent->lookup(name);
-  throw undeclared_error(name);
+void SymbolTable::insertVar(Ident name) { insertVar(name, offset++); }
+void SymbolTable::insertVar(Ident name, int64_t offset) {
+  insert(name, {Symbol::VAR, 0, offset});
 }
-FuncSign SymbolTable::lookupFunc(const std::string &name) const {
-  const Value &val = lookup(name);
-  try {
-    return std::get<FuncSign>(val);
-  } catch (const std::bad_variant_access &) {
-    throw not_func_error(name);
-  }
+void SymbolTable::insertArray(Ident name, const ArrayInfo *array) {
+  insertArray(name, array, offset);
+  offset += array->size();
 }
-int32_t SymbolTable::lookupConst(const std::string &name) const {
-  const Value &val = lookup(name);
-  try {
-    return std::get<int32_t>(val);
-  } catch (const std::bad_variant_access &) {
-    throw not_const_error(name);
-  }
+void SymbolTable::insertArray(Ident name, const ArrayInfo *array,
+                              int64_t offset) {
+  insert(name, {Symbol::VAR, 0, offset, nullptr, array});
+}
+const Symbol &SymbolTable::lookup(Ident name) const {
+  static const Symbol none;
+  auto id = static_cast<size_t>(name.id);
+  if (id >= innermost.size() || innermost[id] == -1)
+    return none;
+  return bindings[innermost[id]].sym;
+}
+const Symbol &SymbolTable::lookupGlobal(Ident name) const {
+  static const Symbol none;
+  auto id = static_cast<size_t>(name.id);
+  for (int32_t b = id < innermost.size() ? innermost[id] : -1; b != -1;
+       b = bindings[b].shadowed)
+    if (!bindings[b].depth)
+      return bindings[b].sym;
+  return none;
+}
+const FuncSign *SymbolTable::lookupFunc(Ident name) const {
+  return lookup(name).func;
 }
+int64_t SymbolTable::getOffset() const { return offset; }
 std::ostream &operator<<(std::ostream &os, const SymbolTable &symtab) {
-  auto visitor = [&os](auto &&arg) {
-    using T = std::decay_t<decltype(arg)>;
-    if constexpr (std::is_same_v<T, int32_t>)
-      os << "(i32) " << arg;
-    else if constexpr (std::is_same_v<T, int64_t>)
-      os << "(var) %" << arg;
-    else if constexpr (std::is_same_v<T, FuncSign>) {
-      os << "(func) ";
-      os << arg.returnType << " (";
-      for (size_t i = 0; i < arg.argTypes.size(); i++) {
+  for (const auto &binding : symtab.bindings) {
+    const Symbol &sym = binding.sym;
+    os << std::string(static_cast<size_t>(binding.depth) * 2, ' ')
+       << *binding.name << " : ";
+    if (sym.kind == Symbol::CONST)
+      os << "(i32) " << sym.value;
+    else if (sym.kind == Symbol::VAR && sym.array) {
+      os << (sym.array->is_const ? "(const" : "(var");
+      for (int32_t dim : sym.array->dims)
+        os << "[" << dim << "]";
+      os << ") %" << sym.offset;
+    } else if (sym.kind == Symbol::VAR)
+      os << "(var) %" << sym.offset;
+    else {
+      os << "(func) " << sym.func->returnType << " (";
+      for (size_t i = 0; i < sym.func->argTypes.size(); i++) {
         if (i > 0)
           os << ", ";
-        os << arg.argTypes[i];
+        os << sym.func->argTypes[i];
       }
       os << ")";
-    } else
-      static_assert(false, "non-exhaustive visitor!");
-  };
-  for (const auto &entry : symtab.table) {
-    os << entry.first << " : ";
-    std::visit(visitor, entry.second);
+    }
     os << std::endl;
   }
   return os;
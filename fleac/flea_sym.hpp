@@ -2,39 +2,92 @@
 #define FLEA_SYM_HPP_FLAG
 
 #include <cstdint>
+#include <deque>
 #include <iostream>
 #include <string>
-#include <unordered_map>
-#include <variant>
+#include <string_view>
 #include <vector>
 
+class BaseAST;
+
+// Identifiers are interned once, by the lexer, into a table shared by the
+// whole process; an Ident is an index into it and dereferences to the name.
+struct Ident {
+  int32_t id;
+  static Ident intern(std::string_view name);
+  static size_t count();
+  const std::string &operator*() const;
+  const std::string *operator->() const { return &**this; }
+  bool operator==(const Ident &other) const { return id == other.id; }
+};
+
+// def is the FuncDefAST of a user function and null for the built-ins.
 class FuncSign {
 public:
   char returnType;
   std::vector<char> argTypes;
-  FuncSign(char returnType, const std::vector<char> &argTypes);
+  BaseAST *def = nullptr;
+  FuncSign(char returnType, const std::vector<char> &argTypes,
+           BaseAST *def = nullptr);
   bool operator==(const FuncSign &other) const;
 };
 
-using Value = std::variant<int32_t, int64_t, FuncSign>;
+// Shape of an array, row-major: its dimensions, the first of which is 0
+// for a parameter, and the elements of a const array.
+struct ArrayInfo {
+  std::vector<int32_t> dims;
+  bool is_const = false;
+  std::vector<int32_t> values;
+  // the number of elements one step of subscript d moves over
+  int64_t stride(size_t d) const;
+  int64_t size() const { return dims.empty() ? 1 : dims[0] * stride(0); }
+};
+
+// What a name stands for: a constant and its value, a variable and its
+// offset (globals count up from 0, locals go on after them and parameter i
+// is at -1-i) or a function. Undeclared names look up as NONE. An array is
+// a variable whose elements take the offsets from its own on.
+struct Symbol {
+  enum Kind : char { NONE, CONST, VAR, FUNC };
+  Kind kind = NONE;
+  int32_t value = 0;
+  int64_t offset = 0;
+  const FuncSign *func = nullptr;
+  const ArrayInfo *array = nullptr;
+};
 
+// One flat table for all open scopes, indexed by Ident: each name points at
+// its innermost binding, which links to the one it shadows. A scope records
+// the top of the binding stack when pushed and unwinds back to it when
+// popped; sibling scopes reuse the same variable offsets.
 class SymbolTable {
 protected:
+  struct Binding {
+    Ident name;
+    int32_t depth, shadowed;
+    Symbol sym;
+  };
   int64_t offset = 0;
-  const SymbolTable *parent;
-  std::unordered_map<std::string, Value> table;
+  std::vector<Binding> bindings;
+  std::vector<int32_t> innermost;
+  std::vector<std::pair<size_t, int64_t>> scopes;
+  std::deque<FuncSign> funcs;
+  void insert(Ident name, const Symbol &sym);
 
 public:
-  SymbolTable(const SymbolTable *parent = nullptr);
-  void clear();
-  void insert(const std::string &name, const Value &val);
-  void insertConst(const std::string &name, int32_t val);
-  void insertVar(const std::string &name);
-  void insertVar(const std::string &name, int64_t offset);
-  void insertFunc(const std::string &name, const FuncSign &val);
-  const Value &lookup(const std::string &name) const;
-  FuncSign lookupFunc(const std::string &name) const;
-  int32_t lookupConst(const std::string &name) const;
+  void push();
+  void pop();
+  void insertConst(Ident name, int32_t val);
+  void insertVar(Ident name);
+  void insertVar(Ident name, int64_t offset);
+  void insertArray(Ident name, const ArrayInfo *array);
+  void insertArray(Ident name, const ArrayInfo *array, int64_t offset);
+  void insertFunc(Ident name, const FuncSign &val);
+  const Symbol &lookup(Ident name) const;
+  const Symbol &lookupGlobal(Ident name) const;
+  const FuncSign *lookupFunc(Ident name) const;
+  int64_t getOffset() const;
+  size_t size() const { return bindings.size(); }
   friend std::ostream &operator<<(std::ostream &os, const SymbolTable &symtab);
 };
 
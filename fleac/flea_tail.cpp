@@ -0,0 +1,148 @@
+#include "flea_opt.hpp"
+
+// Follows the empty blocks that only jump on from block to the one that
+// ends the path.
+static const Block &path_end(const Function &func, const Block &block) {
+  const Block *end = &block;
+  for (size_t steps = 0; end->term == Block::JMP && steps < func.blocks.size();
+       ++steps) {
+    const Block &next = func.blocks[end->succ[0]];
+    if (!next.insts.empty())
+      break;
+    end = &next;
+  }
+  return *end;
+}
+
+// Returns the block's recursive call if the block returns its result, or
+// ends a void function right after it. A result stored to a global first
+// does not count, as the jump would drop the store.
+static Inst *self_tail_call(Function &func, Block &block, int32_t self) {
+  if (block.insts.empty())
+    return nullptr;
+  Inst &call = block.insts.back();
+  const Block &end = path_end(func, block);
+  if (call.op != Op::CALL || call.func != self || end.term != Block::RET)
+    return nullptr;
+  if (func.ret_int ? &end != &block || call.dst != block.cond ||
+                         !call.dst.is_temp()
+                   : end.cond.kind != Operand::NONE)
+    return nullptr;
+  return &call;
+}
+
+// Returns the operator of a block ending in `return f(...) op e`, op being
+// + or *, with e evaluated before the recursive call, and 0 otherwise. e
+// must be an immediate or a temp: a global read after the call may see
+// what the call stored, so it cannot be folded in before it.
+static char accumulated_call(Block &block, int32_t self) {
+  auto n = block.insts.size();
+  if (block.term != Block::RET || n < 2)
+    return 0;
+  const Inst &call = block.insts[n - 2], &op = block.insts[n - 1];
+  if (call.op != Op::CALL || call.func != self || !call.dst.is_temp() ||
+      op.op != Op::BIN || (op.sub != '+' && op.sub != '*') ||
+      op.dst != block.cond || (op.a == call.dst) == (op.b == call.dst))
+    return 0;
+  const Operand &e = op.a == call.dst ? op.b : op.a;
+  if (!e.is_imm() && !e.is_temp())
+    return 0;
+  return op.sub;
+}
+
+// Turns self-recursive calls in tail position into jumps back to the top of
+// the function that reassign the parameters. A recursive call whose result
+// is added to or multiplied by a value evaluated before it is handled by
+// carrying that value in an accumulator, which every other return applies.
+static void eliminate_tail_recursion(Function &func, int32_t self) {
+  std::vector<int32_t> tails;
+  char acc_op = 0;
+  bool mixed = false;
+  for (int32_t b = 0; b < static_cast<int32_t>(func.blocks.size()); ++b) {
+    Block &block = func.blocks[b];
+    if (self_tail_call(func, block, self)) {
+      tails.push_back(b);
+    } else if (char op = func.ret_int ? accumulated_call(block, self) : 0) {
+      mixed |= acc_op && acc_op != op;
+      acc_op = op;
+      tails.push_back(b);
+    }
+  }
+  if (mixed) {
+    std::erase_if(tails, [&](int32_t b) {
+      return !self_tail_call(func, func.blocks[b], self);
+    });
+    acc_op = 0;
+  }
+  if (tails.empty())
+    return;
+
+  int32_t top = func.new_block();
+  std::swap(func.blocks[0], func.blocks[top]);
+  for (auto &block : func.blocks)
+    for (int32_t k = 0; k < block.succ_count(); ++k)
+      if (block.succ[k] == 0)
+        block.succ[k] = top;
+  Block &entry = func.blocks[0];
+  entry.term = Block::JMP, entry.succ[0] = top;
+  Operand acc;
+  if (acc_op) {
+    acc = Operand::temp(func.new_temp());
+    entry.insts.emplace_back(Op::MOV, acc, Operand::imm(acc_op == '*'));
+  }
+  for (int32_t b : tails) {
+    Block &block = func.blocks[b];
+    Inst *call = self_tail_call(func, block, self);
+    if (!call) {
+      // return f(...) op e: fold e into the accumulator first
+      Inst op = std::move(block.insts.back());
+      block.insts.pop_back();
+      Operand e = op.a == block.insts.back().dst ? op.b : op.a;
+      block.insts.emplace_back(Op::BIN, acc, acc, e, acc_op);
+      std::swap(block.insts[block.insts.size() - 2], block.insts.back());
+    }
+    Inst last = std::move(block.insts.back());
+    block.insts.pop_back();
+    std::vector<Operand> temps;
+    for (const auto &arg : last.args) {
+      temps.push_back(Operand::temp(func.new_temp()));
+      block.insts.emplace_back(Op::MOV, temps.back(), arg);
+    }
+    for (size_t i = 0; i < temps.size(); ++i)
+      block.insts.emplace_back(Op::MOV, Operand::temp(static_cast<int32_t>(i)),
+                               temps[i]);
+    block.term = Block::JMP, block.cond = Operand(), block.succ[0] = top;
+  }
+  if (!acc_op)
+    return;
+  for (auto &block : func.blocks) {
+    if (block.term != Block::RET)
+      continue;
+    Operand val = Operand::temp(func.new_temp());
+    block.insts.emplace_back(Op::BIN, val, acc, block.cond, acc_op);
+    block.cond = val;
+  }
+}
+
+void eliminate_tail_recursion(Module &mod) {
+  for (int32_t f = 0; f < static_cast<int32_t>(mod.funcs.size()); ++f)
+    if (f != mod.main_id && !mod.funcs[f].frame_size)
+      eliminate_tail_recursion(mod.funcs[f], f);
+}
+
+void mark_tail_calls(Module &mod, int32_t func_id) {
+  const Function &func = mod.funcs[func_id];
+  if (func_id == mod.main_id || func.frame_size)
+    return;
+  for (auto &block : mod.funcs[func_id].blocks) {
+    if (block.term != Block::RET || block.insts.empty())
+      continue;
+    Inst &call = block.insts.back();
+    if (call.op != Op::CALL || call.func == mod.main_id ||
+        mod.funcs[call.func].nparams > func.nparams)
+      continue;
+    if (func.ret_int ? call.dst == block.cond && call.dst.is_temp()
+                     : block.cond.kind == Operand::NONE)
+      call.tail = true;
+  }
+}
@@ -1,40 +1,204 @@
 #include "flea_ast.hpp"
+#include "flea_cache.hpp"
+#include "flea_emit.hpp"
+#include "flea_err.hpp"
+#include "flea_ir.hpp"
+#include "flea_lex.hpp"
+#include "flea_opt.hpp"
+#include "flea_pool.hpp"
+#include "flea_report.hpp"
+#include "flea_run.hpp"
 #include "flea_sym.hpp"
 #include <cassert>
-#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
-extern FILE *yyin;
-extern int yyparse(unique_ptr<BaseAST> &ast);
+extern int yyparse(unique_ptr<CompUnitAST> &ast);
 
 int main(int argc, const char *argv[]) {
-  if (argc != 2) {
-    cerr << "Usage: " << argv[0] << " <input>" << endl;
+  const char *input = nullptr, *output = nullptr, *cache_dir = nullptr;
+  const char *line_table = nullptr;
+  bool dump_ast = false, dump_ir = false, time_report = false, json = false;
+  bool bounds_check = false, run = false;
+  int opt_level = 2;
+  int32_t inline_threshold = PassManager::default_inline_threshold;
+  unsigned jobs = max(thread::hardware_concurrency(), 1u);
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--ast"))
+      dump_ast = true;
+    else if (!strcmp(argv[i], "--ir"))
+      dump_ir = true;
+    else if (!strcmp(argv[i], "--run"))
+      run = true;
+    else if (!strcmp(argv[i], "--bounds-check"))
+      bounds_check = true;
+    else if (!strcmp(argv[i], "--time-report"))
+      time_report = true;
+    else if (!strcmp(argv[i], "--time-report=json"))
+      time_report = json = true;
+    else if (!strcmp(argv[i], "-O0") || !strcmp(argv[i], "-O1") ||
+             !strcmp(argv[i], "-O2"))
+      opt_level = argv[i][2] - '0';
+    else if (!strncmp(argv[i], "--inline-threshold=", 19))
+      inline_threshold =
+          static_cast<int32_t>(strtol(argv[i] + 19, nullptr, 10));
+    else if (!strncmp(argv[i], "-j", 2) && argv[i][2])
+      jobs = static_cast<unsigned>(max(strtol(argv[i] + 2, nullptr, 10), 1l));
+    else if (!strncmp(argv[i], "--cache-dir=", 12))
+      cache_dir = argv[i] + 12;
+    else if (!strncmp(argv[i], "--line-table=", 13))
+      line_table = argv[i] + 13;
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+      output = argv[++i];
+    else if (!input)
+      input = argv[i];
+    else
+      input = nullptr, i = argc;
+  }
+  if (!input) {
+    cerr << "Usage: " << argv[0]
+         << " [--ast] [--ir] [-O0|-O1|-O2] [--inline-threshold=<n>]"
+            " [-j<n>] [--cache-dir=<dir>] [--bounds-check]"
+            " [--time-report[=json]]"
+            " [--run | -o <output> [--line-table=<file>]] <input>"
+         << endl;
     return 1;
   }
-  auto input = argv[1];
 
-  yyin = fopen(input, "r");
-  if (!yyin) {
+  optional<TimeReport> report;
+  if (time_report)
+    report.emplace();
+  MappedFile source(input);
+  if (!source.ok()) {
     cerr << "Failed to open file: " << input << endl;
     return 1;
   }
+  lex_init(source.data(), source.data() + source.size());
+
+  // with --run the program runs once the pool is gone, as it never returns
+  vector<int32_t> data;
+  vector<FleaCode> program;
+  LineTable lines;
+  unique_ptr<CompUnitAST> ast;
+  try {
+    // yyparse lexes as it goes, so for the report the lexer first runs
+    // alone and its time is taken out of parsing
+    if (report) {
+      uint64_t tokens = 0;
+      {
+        TimeReport::Timer timer("lexing");
+        while (yylex())
+          ++tokens;
+      }
+      report->set("tokens", tokens);
+      lex_init(source.data(), source.data() + source.size());
+    }
+    {
+      TimeReport::Timer timer("parsing");
+      if (int ret = yyparse(ast))
+        return ret;
+    }
+    if (report)
+      report->phase("parsing").ms -= report->phase("lexing").ms;
+
+    // functions are checked, lowered, optimized and emitted on the pool;
+    // results and errors are taken in the order of the source
+    ThreadPool pool(jobs);
+    ast->pool = &pool;
 
-  unique_ptr<BaseAST> ast;
-  int ret = yyparse(ast);
-  if (ret != 0)
-    return fclose(yyin), ret;
+    // semanticAnalysis
+    {
+      TimeReport::Timer timer("semantic analysis");
+      ast->const_eval(nullptr);
+    }
+    if (dump_ast)
+      cout << *ast << endl;
 
-  cout << *ast << endl;
+    Module mod;
+    IRGen gen(mod);
+    gen.bounds_check = bounds_check;
+    {
+      TimeReport::Timer timer("IR generation");
+      ast->gen(gen, nullptr);
+    }
+    PassManager passes(opt_level, inline_threshold);
+    passes.run_module(mod);
 
-  // semanticAnalysis
-  ast->const_eval(nullptr);
-  cout << *ast << endl;
+    // with a cache, functions whose IR is unchanged after the passes across
+    // functions skip their own passes and emission
+    bool emit = !dump_ast && !dump_ir;
+    optional<FuncCache> cache;
+    if (cache_dir && emit)
+      cache.emplace(cache_dir, opt_level, inline_threshold);
+    vector<FleaFunc> funcs(mod.funcs.size());
+    {
+      TimeReport::Timer timer("optimization and emission");
+      pool.run(mod.funcs.size(), [&](unsigned, size_t i) {
+        auto f = static_cast<int32_t>(i);
+        uint64_t key = cache ? cache->key(mod, f) : 0;
+        if (cache) {
+          TimeReport::Timer timer("cache lookup", true);
+          if (cache->load(key, mod, f, funcs[i]))
+            return;
+        }
+        passes.run(mod, f);
+        if (!emit)
+          return;
+        TimeReport::Timer timer("emission", true);
+        funcs[i] = emit_func(mod, f);
+        if (cache)
+          cache->store(key, mod, f, funcs[i]);
+      });
+    }
+    if (dump_ir)
+      cout << mod;
 
-  fclose(yyin);
+    if (emit && run) {
+      TimeReport::Timer timer("linking");
+      program = link_code(mod, funcs);
+      lines = link_lines(mod, funcs, input);
+      data = std::move(mod.data);
+    } else if (emit) {
+      ofstream ofs;
+      if (output && (ofs.open(output), !ofs)) {
+        cerr << "Failed to open file: " << output << endl;
+        return 1;
+      }
+      TimeReport::Timer timer("linking");
+      link_module(mod, funcs, output ? ofs : cout);
+      if (line_table) {
+        ofstream lts(line_table);
+        if (!(lts << link_lines(mod, funcs, input))) {
+          cerr << "Failed to write file: " << line_table << endl;
+          return 1;
+        }
+      }
+    }
+    if (report) {
+      size_t insts = 0;
+      for (const auto &func : mod.funcs)
+        for (const auto &block : func.blocks)
+          insts += block.insts.size();
+      report->set("identifiers", Ident::count());
+      report->set("global symbols", ast->stb.size());
+      report->set("functions", mod.funcs.size());
+      report->set("IR instructions", insts);
+      report->print(cerr, json);
+    }
+  } catch (const flea_compiler_error &e) {
+    cerr << "Error: " << e.what() << endl;
+    return 1;
+  }
+  if (!program.empty())
+    run_program(data, program, lines);
   return 0;
-}
\ No newline at end of file
+}
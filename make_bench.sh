@@ -0,0 +1,2 @@
+cd bench
+clang++ -o flea_bench flea_bench.cpp flea_synth.cpp main.cpp -O2 -std=c++20 -Wall -Wextra
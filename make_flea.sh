@@ -1,2 +1,3 @@
 cd flea
-clang++ flea.cpp -o flea -O3 -ffast-math -Wall -Wextra -DDEBUG_MODE_ENABLED -DFLUSH_ENABLED -DEXITING_LOG_ENABLED
+clang++ flea.cpp -o flea -O3 -ffast-math -Wall -Wextra -DDEBUG_MODE_ENABLED -DFLUSH_ENABLED -DEXITING_LOG_ENABLED -DFLIGHT_RECORDER_ENABLED -DLINE_TABLE_ENABLED
+clang++ flea_fr.cpp -o flea_fr -O2 -Wall -Wextra
@@ -0,0 +1,17 @@
+fleac=${1:-../fleac/fleac}
+cd tests
+fail=0
+for f in *.sy; do
+  b=${f%.sy}
+  in=/dev/null; [ -f $b.in ] && in=$b.in
+  for o in -O0 -O1 -O2; do
+    out=$($fleac $o --run $f < $in 2>/dev/null)
+    code=$?
+    if [ "$(printf '%s\n%s' "$out" $code)" != "$(cat $b.out)" ]; then
+      echo "FAIL $b $o"
+      fail=1
+    fi
+  done
+done
+[ $fail = 0 ] && echo "All tests passed."
+exit $fail